@@ -0,0 +1,383 @@
+/* *********************************************
+* This example lets the program pick the concrete
+* STRATEGY itself. Several implementations of the same
+* FlyBehavior are registered by name, an autotuner runs
+* each one on a representative workload and the fastest
+* is bound to the ducks. The winner is cached in a file
+* together with the CPU it was measured on, so later
+* runs on the same host skip the tuning pass.
+*
+* Usage: chapter1_6 [--retune] [cache file]
+********************************************* */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        // Altitude gained after the given number of wing beats.
+        virtual float fly(unsigned wingBeats) const = 0;
+};
+
+/* *********************************************
+* Three implementations of the same flight model:
+* every wing beat adds lift and drag slows the climb,
+* v(n+1) = v(n) * drag + lift, altitude += v(n+1).
+********************************************* */
+
+static constexpr float lift = 0.5f;
+static constexpr float drag = 0.9f;
+static constexpr unsigned maxWingBeats = 256;
+
+class FlyWithWingsIterative : public FlyBehavior
+{
+    public:
+        float fly(unsigned wingBeats) const override{
+            float velocity = 0.0f;
+            float altitude = 0.0f;
+            for(unsigned i = 0; i < wingBeats; ++i)
+            {
+                velocity = velocity * drag + lift;
+                altitude += velocity;
+            }
+            return altitude;
+        }
+};
+
+class FlyWithWingsClosedForm : public FlyBehavior
+{
+    public:
+        float fly(unsigned wingBeats) const override{
+            // sum of the geometric series of velocities
+            const float terminal = lift / (1.0f - drag);
+            const float n = static_cast<float>(wingBeats);
+            return terminal * (n - drag * (1.0f - std::pow(drag, n)) / (1.0f - drag));
+        }
+};
+
+class FlyWithWingsTable : public FlyBehavior
+{
+    public:
+        FlyWithWingsTable() : m_altitudes()
+        {
+            FlyWithWingsIterative iterative;
+            for(unsigned i = 0; i < maxWingBeats; ++i)
+            {
+                m_altitudes[i] = iterative.fly(i);
+            }
+        }
+
+        float fly(unsigned wingBeats) const override{
+            if(wingBeats < maxWingBeats)
+            {
+                return m_altitudes[wingBeats];
+            }
+            return FlyWithWingsIterative().fly(wingBeats);
+        }
+
+    private:
+        std::array<float, maxWingBeats> m_altitudes;
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        float fly(unsigned wingBeats) const override{
+            (void)wingBeats;
+            return 0.0f;
+        }
+};
+
+/* *********************************************
+* Registry of named implementations of a strategy
+* interface. It only stores factories, every duck gets
+* its own instance from create().
+********************************************* */
+
+template<typename Interface>
+class StrategyRegistry {
+
+    public:
+        using Factory = std::function<std::unique_ptr<Interface>()>;
+
+        StrategyRegistry() : m_names(), m_factories()
+        {
+
+        }
+
+        void add(const std::string& name, Factory factory) {
+            m_names.push_back(name);
+            m_factories.push_back(std::move(factory));
+        }
+
+        const std::vector<std::string>& names() const {
+            return m_names;
+        }
+
+        bool contains(const std::string& name) const {
+            for(const auto& registered : m_names)
+            {
+                if(registered == name)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::unique_ptr<Interface> create(const std::string& name) const {
+            for(std::size_t i = 0; i < m_names.size(); ++i)
+            {
+                if(m_names[i] == name)
+                {
+                    return m_factories[i]();
+                }
+            }
+            throw std::invalid_argument("unknown strategy: " + name);
+        }
+
+    private:
+        std::vector<std::string> m_names;
+        std::vector<Factory> m_factories;
+};
+
+/* *********************************************
+* Autotuner. The workload is a function running one
+* strategy instance for a while and returning a
+* checksum; implementations whose checksum disagrees
+* with the first one are rejected instead of timed.
+********************************************* */
+
+template<typename Interface>
+class Autotuner {
+
+    public:
+        using Workload = std::function<double(const Interface&)>;
+
+        Autotuner(const StrategyRegistry<Interface>& registry, Workload workload, std::string cacheFile)
+            : m_registry(registry), m_workload(std::move(workload)), m_cacheFile(std::move(cacheFile))
+        {
+
+        }
+
+        // Returns the name of the fastest implementation, from the cache when it is valid.
+        std::string fastest(bool forceRetune) {
+            std::string cached;
+            if(!forceRetune && readCache(cached))
+            {
+                std::cout << "autotune: using cached winner " << cached << std::endl;
+                return cached;
+            }
+
+            std::string winner = tune();
+            writeCache(winner);
+            return winner;
+        }
+
+    private:
+        static constexpr int repetitions = 5;
+
+        std::string tune() {
+            std::string winner;
+            double bestSeconds = std::numeric_limits<double>::max();
+            double reference = std::numeric_limits<double>::quiet_NaN();
+
+            for(const auto& name : m_registry.names())
+            {
+                std::unique_ptr<Interface> candidate = m_registry.create(name);
+                double seconds = std::numeric_limits<double>::max();
+                double checksum = 0.0;
+
+                // best of several runs, the first one also warms the caches
+                for(int run = 0; run < repetitions; ++run)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    checksum = m_workload(*candidate);
+                    auto stop = std::chrono::steady_clock::now();
+                    seconds = std::min(seconds, std::chrono::duration<double>(stop - start).count());
+                }
+
+                if(std::isnan(reference))
+                {
+                    reference = checksum;
+                }
+                if(std::abs(checksum - reference) > 1e-3 * std::abs(reference))
+                {
+                    std::cout << "autotune: " << name << " rejected, result differs" << std::endl;
+                    continue;
+                }
+
+                std::cout << "autotune: " << name << " " << seconds * 1e3 << " ms" << std::endl;
+                if(seconds < bestSeconds)
+                {
+                    bestSeconds = seconds;
+                    winner = name;
+                }
+            }
+
+            if(winner.empty())
+            {
+                throw std::runtime_error("autotune: no usable strategy");
+            }
+            return winner;
+        }
+
+        // The cache is valid only for the same CPU and a strategy that is still registered.
+        bool readCache(std::string& winner) const {
+            std::ifstream in(m_cacheFile);
+            std::string cpu;
+            if(!std::getline(in, cpu) || !std::getline(in, winner))
+            {
+                return false;
+            }
+            return cpu == cpuModel() && m_registry.contains(winner);
+        }
+
+        void writeCache(const std::string& winner) const {
+            std::ofstream out(m_cacheFile);
+            out << cpuModel() << std::endl << winner << std::endl;
+            if(!out)
+            {
+                std::cout << "autotune: could not write " << m_cacheFile << std::endl;
+            }
+        }
+
+        static std::string cpuModel() {
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while(std::getline(cpuinfo, line))
+            {
+                if(line.rfind("model name", 0) == 0)
+                {
+                    return line.substr(line.find(':') + 2);
+                }
+            }
+            return "unknown cpu";
+        }
+
+        const StrategyRegistry<Interface>& m_registry;
+        Workload m_workload;
+        std::string m_cacheFile;
+};
+
+class Duck{
+
+    public:
+        Duck(std::unique_ptr<FlyBehavior> fb) : m_flyBehavior(std::move(fb)), m_altitude(0.0f)
+        {
+
+        }
+
+        virtual ~Duck() = default;
+
+        virtual void display() = 0;
+
+        void performFly(unsigned wingBeats) {
+            m_altitude += m_flyBehavior->fly(wingBeats);
+        };
+
+        float altitude() const {
+            return m_altitude;
+        }
+
+        void setFlyBehavior(std::unique_ptr<FlyBehavior> fb) {
+            if(fb != nullptr){
+                m_flyBehavior = std::move(fb);
+            }
+        }
+
+    private:
+        std::unique_ptr<FlyBehavior> m_flyBehavior;
+        float m_altitude;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        explicit MallardDuck(std::unique_ptr<FlyBehavior> fb) : Duck(std::move(fb))
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I'm a mallard duck" << std::endl;
+        }
+};
+
+class DecoyDuck : public Duck {
+
+    public:
+        DecoyDuck() : Duck(std::make_unique<FlyNoWay>())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a decoy duck" << std::endl;
+        }
+};
+
+int main(int argc, char* argv[])
+{
+    std::cout << "chapter 1 - strategy picked by an autotuner" << std::endl;
+
+    bool retune = false;
+    std::string cacheFile = "flyBehavior.autotune";
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if(argument == "--retune")
+        {
+            retune = true;
+        }
+        else
+        {
+            cacheFile = argument;
+        }
+    }
+
+    StrategyRegistry<FlyBehavior> flyBehaviors;
+    flyBehaviors.add("iterative", [](){ return std::make_unique<FlyWithWingsIterative>(); });
+    flyBehaviors.add("closed-form", [](){ return std::make_unique<FlyWithWingsClosedForm>(); });
+    flyBehaviors.add("table", [](){ return std::make_unique<FlyWithWingsTable>(); });
+
+    // representative workload: short and long flights mixed like in a real flock
+    auto workload = [](const FlyBehavior& behavior){
+        double total = 0.0;
+        for(unsigned round = 0; round < 2000; ++round)
+        {
+            for(unsigned wingBeats = 0; wingBeats < 200; wingBeats += 7)
+            {
+                total += static_cast<double>(behavior.fly(wingBeats));
+            }
+        }
+        return total;
+    };
+
+    Autotuner<FlyBehavior> autotuner(flyBehaviors, workload, cacheFile);
+    const std::string winner = autotuner.fastest(retune);
+    std::cout << "binding fly behavior: " << winner << std::endl << std::endl;
+
+    MallardDuck mallard(flyBehaviors.create(winner));
+    DecoyDuck decoy;
+
+    for(Duck* duck : {static_cast<Duck*>(&mallard), static_cast<Duck*>(&decoy)})
+    {
+        duck->display();
+        duck->performFly(10);
+        std::cout << "altitude after 10 wing beats: " << duck->altitude() << std::endl;
+        std::cout << std::endl;
+    }
+}
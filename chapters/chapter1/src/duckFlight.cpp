@@ -0,0 +1,436 @@
+/* *********************************************
+* This example turns the fly STRATEGY into a real
+* flight simulation. Every duck has a position and a
+* velocity, stored as structure-of-arrays floats and
+* grouped by fly behavior. FlyWithWings, FlyRocketPowered
+* and FlyNoWay are integration kernels advancing a whole
+* group per tick.
+*
+* Each kernel exists as scalar code, SSE and AVX2. The
+* widest one the CPU supports is picked at runtime, so
+* the binary still runs on machines without AVX2.
+*
+* The program ends with a ducks-updated-per-second figure
+* for every kernel flavor on a single core.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DUCK_FLIGHT_X86 1
+#endif
+
+// Positions and velocities of one group of ducks, one array per component.
+struct FlightArrays {
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+
+    FlightArrays() : px(), py(), pz(), vx(), vy(), vz()
+    {
+
+    }
+
+    std::size_t size() const {
+        return px.size();
+    }
+
+    void add(float x, float y, float z) {
+        px.push_back(x); py.push_back(y); pz.push_back(z);
+        vx.push_back(0.0f); vy.push_back(0.0f); vz.push_back(0.0f);
+    }
+
+    // Swap-remove, the last duck takes the place of the removed one.
+    void remove(std::size_t index) {
+        for(auto* component : {&px, &py, &pz, &vx, &vy, &vz})
+        {
+            (*component)[index] = component->back();
+            component->pop_back();
+        }
+    }
+};
+
+/* *********************************************
+* Flight model of the flying behaviors. Forces are
+* a forward thrust along x, lift along z minus gravity,
+* and linear drag:
+*   a = (thrust, 0, lift - gravity) - drag * v
+*   v += a * dt,  p += v * dt
+* Ducks cannot dive below the water surface z = 0.
+********************************************* */
+
+struct FlightParameters {
+    float thrust;
+    float lift;
+    float drag;
+};
+
+static constexpr float gravity = 9.81f;
+
+enum class KernelFlavor { Scalar, SSE, AVX2 };
+
+static void integrateScalar(FlightArrays& d, std::size_t begin, std::size_t end, const FlightParameters& p, float dt)
+{
+    const float liftAcceleration = p.lift - gravity;
+
+    for(std::size_t i = begin; i < end; ++i)
+    {
+        d.vx[i] += (p.thrust - p.drag * d.vx[i]) * dt;
+        d.vy[i] += (-p.drag * d.vy[i]) * dt;
+        d.vz[i] += (liftAcceleration - p.drag * d.vz[i]) * dt;
+
+        d.px[i] += d.vx[i] * dt;
+        d.py[i] += d.vy[i] * dt;
+        d.pz[i] += d.vz[i] * dt;
+
+        if(d.pz[i] < 0.0f)
+        {
+            d.pz[i] = 0.0f;
+            d.vz[i] = 0.0f;
+        }
+    }
+}
+
+#ifdef DUCK_FLIGHT_X86
+
+static void integrateSSE(FlightArrays& d, std::size_t begin, std::size_t end, const FlightParameters& p, float dt)
+{
+    const __m128 thrust = _mm_set1_ps(p.thrust);
+    const __m128 liftAcceleration = _mm_set1_ps(p.lift - gravity);
+    const __m128 minusDrag = _mm_set1_ps(-p.drag);
+    const __m128 step = _mm_set1_ps(dt);
+    const __m128 zero = _mm_setzero_ps();
+
+    std::size_t i = begin;
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(&d.vx[i]);
+        __m128 vy = _mm_loadu_ps(&d.vy[i]);
+        __m128 vz = _mm_loadu_ps(&d.vz[i]);
+
+        vx = _mm_add_ps(vx, _mm_mul_ps(_mm_add_ps(thrust, _mm_mul_ps(minusDrag, vx)), step));
+        vy = _mm_add_ps(vy, _mm_mul_ps(_mm_mul_ps(minusDrag, vy), step));
+        vz = _mm_add_ps(vz, _mm_mul_ps(_mm_add_ps(liftAcceleration, _mm_mul_ps(minusDrag, vz)), step));
+
+        __m128 px = _mm_add_ps(_mm_loadu_ps(&d.px[i]), _mm_mul_ps(vx, step));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(&d.py[i]), _mm_mul_ps(vy, step));
+        __m128 pz = _mm_add_ps(_mm_loadu_ps(&d.pz[i]), _mm_mul_ps(vz, step));
+
+        // below the surface: clamp position and stop vertical motion
+        __m128 underwater = _mm_cmplt_ps(pz, zero);
+        pz = _mm_andnot_ps(underwater, pz);
+        vz = _mm_andnot_ps(underwater, vz);
+
+        _mm_storeu_ps(&d.vx[i], vx);
+        _mm_storeu_ps(&d.vy[i], vy);
+        _mm_storeu_ps(&d.vz[i], vz);
+        _mm_storeu_ps(&d.px[i], px);
+        _mm_storeu_ps(&d.py[i], py);
+        _mm_storeu_ps(&d.pz[i], pz);
+    }
+
+    integrateScalar(d, i, end, p, dt);
+}
+
+__attribute__((target("avx2")))
+static void integrateAVX2(FlightArrays& d, std::size_t begin, std::size_t end, const FlightParameters& p, float dt)
+{
+    const __m256 thrust = _mm256_set1_ps(p.thrust);
+    const __m256 liftAcceleration = _mm256_set1_ps(p.lift - gravity);
+    const __m256 minusDrag = _mm256_set1_ps(-p.drag);
+    const __m256 step = _mm256_set1_ps(dt);
+    const __m256 zero = _mm256_setzero_ps();
+
+    std::size_t i = begin;
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(&d.vx[i]);
+        __m256 vy = _mm256_loadu_ps(&d.vy[i]);
+        __m256 vz = _mm256_loadu_ps(&d.vz[i]);
+
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(_mm256_add_ps(thrust, _mm256_mul_ps(minusDrag, vx)), step));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(_mm256_mul_ps(minusDrag, vy), step));
+        vz = _mm256_add_ps(vz, _mm256_mul_ps(_mm256_add_ps(liftAcceleration, _mm256_mul_ps(minusDrag, vz)), step));
+
+        __m256 px = _mm256_add_ps(_mm256_loadu_ps(&d.px[i]), _mm256_mul_ps(vx, step));
+        __m256 py = _mm256_add_ps(_mm256_loadu_ps(&d.py[i]), _mm256_mul_ps(vy, step));
+        __m256 pz = _mm256_add_ps(_mm256_loadu_ps(&d.pz[i]), _mm256_mul_ps(vz, step));
+
+        __m256 underwater = _mm256_cmp_ps(pz, zero, _CMP_LT_OQ);
+        pz = _mm256_andnot_ps(underwater, pz);
+        vz = _mm256_andnot_ps(underwater, vz);
+
+        _mm256_storeu_ps(&d.vx[i], vx);
+        _mm256_storeu_ps(&d.vy[i], vy);
+        _mm256_storeu_ps(&d.vz[i], vz);
+        _mm256_storeu_ps(&d.px[i], px);
+        _mm256_storeu_ps(&d.py[i], py);
+        _mm256_storeu_ps(&d.pz[i], pz);
+    }
+
+    integrateScalar(d, i, end, p, dt);
+}
+
+#endif
+
+static bool isSupported(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::Scalar:
+            return true;
+#ifdef DUCK_FLIGHT_X86
+        case KernelFlavor::SSE:
+            return __builtin_cpu_supports("sse2");
+        case KernelFlavor::AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        default:
+            return false;
+#endif
+    }
+    return false;
+}
+
+static KernelFlavor bestFlavor()
+{
+    for(KernelFlavor flavor : {KernelFlavor::AVX2, KernelFlavor::SSE})
+    {
+        if(isSupported(flavor))
+        {
+            return flavor;
+        }
+    }
+    return KernelFlavor::Scalar;
+}
+
+static const char* flavorName(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::SSE:
+            return "SSE";
+        case KernelFlavor::AVX2:
+            return "AVX2";
+        case KernelFlavor::Scalar:
+            break;
+    }
+    return "scalar";
+}
+
+static void integrate(KernelFlavor flavor, FlightArrays& d, const FlightParameters& p, float dt)
+{
+    switch(flavor)
+    {
+#ifdef DUCK_FLIGHT_X86
+        case KernelFlavor::AVX2:
+            integrateAVX2(d, 0, d.size(), p, dt);
+            return;
+        case KernelFlavor::SSE:
+            integrateSSE(d, 0, d.size(), p, dt);
+            return;
+#endif
+        default:
+            integrateScalar(d, 0, d.size(), p, dt);
+            return;
+    }
+}
+
+/* *********************************************
+* Fly behaviors as integration kernels over a group.
+********************************************* */
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual const char* name() const = 0;
+        virtual void fly(KernelFlavor flavor, FlightArrays& ducks, float dt) const = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I'm flying!!";
+        }
+        void fly(KernelFlavor flavor, FlightArrays& ducks, float dt) const override{
+            integrate(flavor, ducks, FlightParameters{4.0f, 10.5f, 0.4f}, dt);
+        }
+};
+
+class FlyRocketPowered : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I'm flying with a rocket!";
+        }
+        void fly(KernelFlavor flavor, FlightArrays& ducks, float dt) const override{
+            integrate(flavor, ducks, FlightParameters{40.0f, 14.0f, 0.1f}, dt);
+        }
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I can't fly";
+        }
+        // no thrust and no lift: the duck settles on the water and drifts to a halt
+        void fly(KernelFlavor flavor, FlightArrays& ducks, float dt) const override{
+            integrate(flavor, ducks, FlightParameters{0.0f, 0.0f, 1.0f}, dt);
+        }
+};
+
+enum class FlyBehaviorId : std::uint8_t { FlyWithWings, FlyNoWay, FlyRocketPowered, Count };
+
+// A flock whose ducks are kept in one FlightArrays group per fly behavior.
+class FlightSimulation {
+
+    public:
+        FlightSimulation(KernelFlavor flavor) : m_flavor(flavor), m_groups(),
+            m_flyWithWings(), m_flyNoWay(), m_flyRocketPowered()
+        {
+
+        }
+
+        void addDuck(FlyBehaviorId behavior, float x, float y, float z) {
+            group(behavior).add(x, y, z);
+        }
+
+        // Moves a duck to the group of its new behavior, keeping its state.
+        void setFlyBehavior(FlyBehaviorId from, std::size_t index, FlyBehaviorId to) {
+            FlightArrays& source = group(from);
+            group(to).add(source.px[index], source.py[index], source.pz[index]);
+            FlightArrays& target = group(to);
+            target.vx.back() = source.vx[index];
+            target.vy.back() = source.vy[index];
+            target.vz.back() = source.vz[index];
+            source.remove(index);
+        }
+
+        void tick(float dt) {
+            m_flyWithWings.fly(m_flavor, group(FlyBehaviorId::FlyWithWings), dt);
+            m_flyNoWay.fly(m_flavor, group(FlyBehaviorId::FlyNoWay), dt);
+            m_flyRocketPowered.fly(m_flavor, group(FlyBehaviorId::FlyRocketPowered), dt);
+        }
+
+        FlightArrays& group(FlyBehaviorId behavior) {
+            return m_groups[static_cast<std::size_t>(behavior)];
+        }
+
+        std::size_t size() const {
+            std::size_t total = 0;
+            for(const auto& flightGroup : m_groups)
+            {
+                total += flightGroup.size();
+            }
+            return total;
+        }
+
+    private:
+        KernelFlavor m_flavor;
+        std::array<FlightArrays, static_cast<std::size_t>(FlyBehaviorId::Count)> m_groups;
+        FlyWithWings m_flyWithWings;
+        FlyNoWay m_flyNoWay;
+        FlyRocketPowered m_flyRocketPowered;
+};
+
+static void fillFlock(FlightSimulation& simulation, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        FlyBehaviorId behavior = static_cast<FlyBehaviorId>(i % static_cast<std::size_t>(FlyBehaviorId::Count));
+        float offset = static_cast<float>(i % 1000);
+        simulation.addDuck(behavior, offset, -offset, static_cast<float>(i % 7));
+    }
+}
+
+int main(void)
+{
+    std::cout << "chapter 1 - strategy as flight integration kernels" << std::endl;
+
+    const KernelFlavor best = bestFlavor();
+    std::cout << "best kernel on this CPU: " << flavorName(best) << std::endl << std::endl;
+
+    FlightSimulation pond(best);
+    pond.addDuck(FlyBehaviorId::FlyWithWings, 0.0f, 0.0f, 0.0f);
+    pond.addDuck(FlyBehaviorId::FlyNoWay, 0.0f, 0.0f, 0.0f);
+    pond.addDuck(FlyBehaviorId::FlyNoWay, 0.0f, 0.0f, 0.0f);
+
+    // the model duck gets a rocket
+    pond.setFlyBehavior(FlyBehaviorId::FlyNoWay, 1, FlyBehaviorId::FlyRocketPowered);
+
+    for(int tick = 0; tick < 100; ++tick)
+    {
+        pond.tick(0.01f);
+    }
+
+    const std::array<const char*, 3> labels = {"mallard", "rubber", "model"};
+    const std::array<FlyBehaviorId, 3> behaviors = {FlyBehaviorId::FlyWithWings, FlyBehaviorId::FlyNoWay, FlyBehaviorId::FlyRocketPowered};
+    for(std::size_t i = 0; i < labels.size(); ++i)
+    {
+        FlightArrays& ducks = pond.group(behaviors[i]);
+        std::cout << labels[i] << " after 1 s: x = " << ducks.px[0] << ", z = " << ducks.pz[0] << std::endl;
+    }
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Benchmark: two million ducks, every kernel
+    * flavor the CPU supports. The results of the SIMD
+    * flavors are checked against the scalar ones.
+    ********************************************* */
+
+    const std::size_t flockSize = 2000000;
+    const int ticks = 50;
+    const float dt = 1.0f / 60.0f;
+
+    FlightSimulation reference(KernelFlavor::Scalar);
+
+    for(KernelFlavor flavor : {KernelFlavor::Scalar, KernelFlavor::SSE, KernelFlavor::AVX2})
+    {
+        if(!isSupported(flavor))
+        {
+            std::cout << flavorName(flavor) << ": not supported" << std::endl;
+            continue;
+        }
+
+        FlightSimulation simulation(flavor);
+        fillFlock(simulation, flockSize);
+
+        auto start = std::chrono::steady_clock::now();
+        for(int tick = 0; tick < ticks; ++tick)
+        {
+            simulation.tick(dt);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+
+        if(flavor == KernelFlavor::Scalar)
+        {
+            reference = std::move(simulation);
+        }
+
+        float maxError = 0.0f;
+        for(auto behavior : behaviors)
+        {
+            FlightArrays& expected = reference.group(behavior);
+            FlightArrays& actual = flavor == KernelFlavor::Scalar ? expected : simulation.group(behavior);
+            for(std::size_t i = 0; i < expected.size(); ++i)
+            {
+                maxError = std::max(maxError, std::abs(expected.px[i] - actual.px[i]));
+                maxError = std::max(maxError, std::abs(expected.pz[i] - actual.pz[i]));
+            }
+        }
+
+        std::cout << flavorName(flavor) << ": "
+                  << static_cast<double>(flockSize) * ticks / seconds / 1e6 << " M ducks updated/s"
+                  << ", max deviation from scalar " << maxError << std::endl;
+    }
+}
@@ -0,0 +1,414 @@
+/* *********************************************
+* This example applies the STRATEGY design pattern
+* to a whole flock at once. Instead of one heap object
+* per duck, the DuckFlock keeps behavior ids, duck kinds
+* and per-duck state in contiguous arrays. performFly and
+* performQuack group the ducks by behavior, so every
+* strategy runs as one tight loop over its ducks.
+*
+* The program ends with a benchmark comparing the flock
+* with a std::list of heap allocated ducks.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <list>
+#include <memory>
+
+enum class FlyBehaviorId : std::uint8_t { FlyWithWings, FlyNoWay, FlyRocketPowered, Count };
+enum class QuackBehaviorId : std::uint8_t { Quack, MuteQuack, Squeak, Count };
+enum class DuckKind : std::uint8_t { Mallard, RedHead, Rubber, Decoy, Model, Count };
+
+// Per-duck state touched by the behaviors.
+struct DuckState {
+    float altitude;
+    std::uint32_t quacks;
+};
+
+/* *********************************************
+* Strategies. Each one works on a single duck state,
+* the flock calls it in a loop over all ducks sharing
+* the behavior so the call is resolved at compile time.
+********************************************* */
+
+class FlyWithWings
+{
+    public:
+        static constexpr const char* description = "I'm flying!!";
+        static void fly(DuckState& state) {
+            state.altitude += 1.0f;
+        }
+};
+
+class FlyNoWay
+{
+    public:
+        static constexpr const char* description = "I can't fly";
+        static void fly(DuckState& state) {
+            (void)state;
+        }
+};
+
+class FlyRocketPowered
+{
+    public:
+        static constexpr const char* description = "I'm flying with a rocket!";
+        static void fly(DuckState& state) {
+            state.altitude += 10.0f;
+        }
+};
+
+class Quack {
+    public:
+        static constexpr const char* description = "Quack";
+        static void quack(DuckState& state) {
+            ++state.quacks;
+        }
+};
+
+class MuteQuack {
+    public:
+        static constexpr const char* description = "Silence";
+        static void quack(DuckState& state) {
+            (void)state;
+        }
+};
+
+class Squeak {
+    public:
+        static constexpr const char* description = "Squeak";
+        static void quack(DuckState& state) {
+            ++state.quacks;
+        }
+};
+
+class DuckFlock {
+
+    public:
+        using Index = std::uint32_t;
+
+        DuckFlock() : m_kinds(), m_flyBehaviors(), m_quackBehaviors(), m_states(),
+            m_flyOrder(), m_flyOffsets(), m_quackOrder(), m_quackOffsets(),
+            m_flyOrderDirty(false), m_quackOrderDirty(false)
+        {
+
+        }
+
+        void reserve(std::size_t count) {
+            m_kinds.reserve(count);
+            m_flyBehaviors.reserve(count);
+            m_quackBehaviors.reserve(count);
+            m_states.reserve(count);
+        }
+
+        Index add(DuckKind kind) {
+            static constexpr std::array<FlyBehaviorId, static_cast<std::size_t>(DuckKind::Count)> defaultFly = {
+                FlyBehaviorId::FlyWithWings, FlyBehaviorId::FlyWithWings, FlyBehaviorId::FlyNoWay,
+                FlyBehaviorId::FlyNoWay, FlyBehaviorId::FlyNoWay};
+            static constexpr std::array<QuackBehaviorId, static_cast<std::size_t>(DuckKind::Count)> defaultQuack = {
+                QuackBehaviorId::Quack, QuackBehaviorId::Quack, QuackBehaviorId::Squeak,
+                QuackBehaviorId::MuteQuack, QuackBehaviorId::Quack};
+
+            Index index = static_cast<Index>(m_kinds.size());
+            m_kinds.push_back(kind);
+            m_flyBehaviors.push_back(defaultFly[static_cast<std::size_t>(kind)]);
+            m_quackBehaviors.push_back(defaultQuack[static_cast<std::size_t>(kind)]);
+            m_states.push_back(DuckState{0.0f, 0});
+            m_flyOrderDirty = true;
+            m_quackOrderDirty = true;
+            return index;
+        }
+
+        std::size_t size() const {
+            return m_kinds.size();
+        }
+
+        void setFlyBehavior(Index duck, FlyBehaviorId fb) {
+            if(m_flyBehaviors[duck] != fb)
+            {
+                m_flyBehaviors[duck] = fb;
+                m_flyOrderDirty = true;
+            }
+        }
+
+        void setQuackBehavior(Index duck, QuackBehaviorId qb) {
+            if(m_quackBehaviors[duck] != qb)
+            {
+                m_quackBehaviors[duck] = qb;
+                m_quackOrderDirty = true;
+            }
+        }
+
+        const DuckState& state(Index duck) const {
+            return m_states[duck];
+        }
+
+        void display(Index duck) const {
+            static constexpr std::array<const char*, static_cast<std::size_t>(DuckKind::Count)> descriptions = {
+                "I'm a mallard duck", "I am a red head duck", "I am a rubber duck",
+                "I am a decoy duck", "I am a model duck"};
+            std::cout << descriptions[static_cast<std::size_t>(m_kinds[duck])] << std::endl;
+        }
+
+        void describeFly(Index duck) const {
+            static constexpr std::array<const char*, static_cast<std::size_t>(FlyBehaviorId::Count)> descriptions = {
+                FlyWithWings::description, FlyNoWay::description, FlyRocketPowered::description};
+            std::cout << descriptions[static_cast<std::size_t>(m_flyBehaviors[duck])] << std::endl;
+        }
+
+        void describeQuack(Index duck) const {
+            static constexpr std::array<const char*, static_cast<std::size_t>(QuackBehaviorId::Count)> descriptions = {
+                Quack::description, MuteQuack::description, Squeak::description};
+            std::cout << descriptions[static_cast<std::size_t>(m_quackBehaviors[duck])] << std::endl;
+        }
+
+        // Runs every fly strategy once over all ducks that use it.
+        void performFly() {
+            if(m_flyOrderDirty)
+            {
+                groupByBehavior(m_flyBehaviors, m_flyOrder, m_flyOffsets);
+                m_flyOrderDirty = false;
+            }
+
+            runGroup(m_flyOrder, m_flyOffsets, FlyBehaviorId::FlyWithWings,
+                [](DuckState& state){ FlyWithWings::fly(state); });
+            runGroup(m_flyOrder, m_flyOffsets, FlyBehaviorId::FlyNoWay,
+                [](DuckState& state){ FlyNoWay::fly(state); });
+            runGroup(m_flyOrder, m_flyOffsets, FlyBehaviorId::FlyRocketPowered,
+                [](DuckState& state){ FlyRocketPowered::fly(state); });
+        }
+
+        // Runs every quack strategy once over all ducks that use it.
+        void performQuack() {
+            if(m_quackOrderDirty)
+            {
+                groupByBehavior(m_quackBehaviors, m_quackOrder, m_quackOffsets);
+                m_quackOrderDirty = false;
+            }
+
+            runGroup(m_quackOrder, m_quackOffsets, QuackBehaviorId::Quack,
+                [](DuckState& state){ Quack::quack(state); });
+            runGroup(m_quackOrder, m_quackOffsets, QuackBehaviorId::MuteQuack,
+                [](DuckState& state){ MuteQuack::quack(state); });
+            runGroup(m_quackOrder, m_quackOffsets, QuackBehaviorId::Squeak,
+                [](DuckState& state){ Squeak::quack(state); });
+        }
+
+    private:
+        template<typename BehaviorId>
+        using Offsets = std::array<Index, static_cast<std::size_t>(BehaviorId::Count) + 1>;
+
+        // Counting sort of the duck indices by behavior id. The sort is stable,
+        // so every group walks the state array in ascending order.
+        template<typename BehaviorId>
+        static void groupByBehavior(const std::vector<BehaviorId>& behaviors, std::vector<Index>& order, Offsets<BehaviorId>& offsets) {
+            offsets.fill(0);
+            for(auto behavior : behaviors)
+            {
+                ++offsets[static_cast<std::size_t>(behavior) + 1];
+            }
+            for(std::size_t i = 1; i < offsets.size(); ++i)
+            {
+                offsets[i] += offsets[i - 1];
+            }
+
+            Offsets<BehaviorId> cursor = offsets;
+            order.resize(behaviors.size());
+            for(std::size_t duck = 0; duck < behaviors.size(); ++duck)
+            {
+                order[cursor[static_cast<std::size_t>(behaviors[duck])]++] = static_cast<Index>(duck);
+            }
+        }
+
+        template<typename BehaviorId, typename Kernel>
+        void runGroup(const std::vector<Index>& order, const Offsets<BehaviorId>& offsets, BehaviorId id, Kernel kernel) {
+            const Index first = offsets[static_cast<std::size_t>(id)];
+            const Index last = offsets[static_cast<std::size_t>(id) + 1];
+            DuckState* states = m_states.data();
+
+            for(Index i = first; i < last; ++i)
+            {
+                kernel(states[order[i]]);
+            }
+        }
+
+        std::vector<DuckKind> m_kinds;
+        std::vector<FlyBehaviorId> m_flyBehaviors;
+        std::vector<QuackBehaviorId> m_quackBehaviors;
+        std::vector<DuckState> m_states;
+
+        std::vector<Index> m_flyOrder;
+        Offsets<FlyBehaviorId> m_flyOffsets;
+        std::vector<Index> m_quackOrder;
+        Offsets<QuackBehaviorId> m_quackOffsets;
+        bool m_flyOrderDirty;
+        bool m_quackOrderDirty;
+};
+
+/* *********************************************
+* Baseline for the benchmark: the classic layout
+* with one heap allocated duck and two heap allocated
+* behaviors per duck, doing the same state updates.
+********************************************* */
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly(DuckState& state) = 0;
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack(DuckState& state) = 0;
+};
+
+template<typename Strategy>
+class FlyAdapter : public FlyBehavior {
+    public:
+        void fly(DuckState& state) override {
+            Strategy::fly(state);
+        }
+};
+
+template<typename Strategy>
+class QuackAdapter : public QuackBehavior {
+    public:
+        void quack(DuckState& state) override {
+            Strategy::quack(state);
+        }
+};
+
+class Duck {
+
+    public:
+        Duck(FlyBehavior* fb, QuackBehavior* qb) : m_flyBehavior(fb), m_quackBehavior(qb), m_state{0.0f, 0}
+        {
+
+        }
+
+        void performFly() {
+            m_flyBehavior->fly(m_state);
+        }
+
+        void performQuack() {
+            m_quackBehavior->quack(m_state);
+        }
+
+        const DuckState& state() const {
+            return m_state;
+        }
+
+    private:
+        std::unique_ptr<FlyBehavior> m_flyBehavior;
+        std::unique_ptr<QuackBehavior> m_quackBehavior;
+        DuckState m_state;
+};
+
+template<typename Function>
+static double measureMilliseconds(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main(void)
+{
+    std::cout << "chapter 1 - strategy over a structure-of-arrays flock" << std::endl;
+
+    DuckFlock flock;
+    DuckFlock::Index mallard = flock.add(DuckKind::Mallard);
+    DuckFlock::Index redHead = flock.add(DuckKind::RedHead);
+    DuckFlock::Index rubber = flock.add(DuckKind::Rubber);
+    DuckFlock::Index decoy = flock.add(DuckKind::Decoy);
+    DuckFlock::Index model = flock.add(DuckKind::Model);
+
+    for(auto duck : {mallard, redHead, rubber, decoy, model})
+    {
+        flock.display(duck);
+        flock.describeQuack(duck);
+        flock.describeFly(duck);
+        std::cout << std::endl;
+    }
+
+    flock.setFlyBehavior(model, FlyBehaviorId::FlyRocketPowered);
+    flock.describeFly(model);
+    flock.performFly();
+    std::cout << "model duck altitude after one tick: " << flock.state(model).altitude << std::endl;
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Benchmark: a flock of one million ducks ticked
+    * a few times, compared with the list of pointers.
+    ********************************************* */
+
+    const std::size_t flockSize = 1000000;
+    const std::size_t ticks = 10;
+
+    DuckFlock bigFlock;
+    bigFlock.reserve(flockSize);
+    std::list<std::unique_ptr<Duck>> ducks;
+
+    for(std::size_t i = 0; i < flockSize; ++i)
+    {
+        DuckKind kind = static_cast<DuckKind>(i % static_cast<std::size_t>(DuckKind::Count));
+        DuckFlock::Index index = bigFlock.add(kind);
+
+        switch(kind)
+        {
+            case DuckKind::Mallard:
+            case DuckKind::RedHead:
+                ducks.push_back(std::make_unique<Duck>(new FlyAdapter<FlyWithWings>, new QuackAdapter<Quack>));
+                break;
+            case DuckKind::Rubber:
+                ducks.push_back(std::make_unique<Duck>(new FlyAdapter<FlyNoWay>, new QuackAdapter<Squeak>));
+                break;
+            case DuckKind::Decoy:
+                ducks.push_back(std::make_unique<Duck>(new FlyAdapter<FlyNoWay>, new QuackAdapter<MuteQuack>));
+                break;
+            case DuckKind::Model:
+            case DuckKind::Count:
+                ducks.push_back(std::make_unique<Duck>(new FlyAdapter<FlyRocketPowered>, new QuackAdapter<Quack>));
+                bigFlock.setFlyBehavior(index, FlyBehaviorId::FlyRocketPowered);
+                break;
+        }
+    }
+
+    double listMs = measureMilliseconds([&](){
+        for(std::size_t tick = 0; tick < ticks; ++tick)
+        {
+            for(auto& duck : ducks)
+            {
+                duck->performFly();
+                duck->performQuack();
+            }
+        }
+    });
+
+    double flockMs = measureMilliseconds([&](){
+        for(std::size_t tick = 0; tick < ticks; ++tick)
+        {
+            bigFlock.performFly();
+            bigFlock.performQuack();
+        }
+    });
+
+    std::cout << "ducks: " << flockSize << ", ticks: " << ticks << std::endl;
+    std::cout << "list of pointers: " << listMs << " ms" << std::endl;
+    std::cout << "DuckFlock:        " << flockMs << " ms" << std::endl;
+    // every duck, in the order both were built, so a grouping bug that moves ducks around shows up
+    bool same = true;
+    DuckFlock::Index index = 0;
+    for(const auto& duck : ducks)
+    {
+        const DuckState& expected = duck->state();
+        const DuckState& actual = bigFlock.state(index++);
+        same = same && expected.altitude == actual.altitude && expected.quacks == actual.quacks;
+    }
+    std::cout << "same result: " << std::boolalpha << same << std::endl;
+}
@@ -0,0 +1,478 @@
+/* *********************************************
+* This example combines the STRATEGY design pattern
+* with the FLYWEIGHT pattern. Behaviors have no state,
+* so every duck references one shared, immutable
+* instance of its behavior instead of owning a copy.
+* Ducks themselves are carved out of a pool, which
+* turns creating and destroying ducks into a free list
+* push/pop instead of a malloc/free pair.
+*
+* The program ends with an allocation count and a
+* timing for creating one million ducks both ways.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <vector>
+
+/* *********************************************
+* Counting replacement of the global allocation
+* functions, used only for the report.
+********************************************* */
+
+static std::size_t g_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++g_allocations;
+    if(void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t size) noexcept
+{
+    (void)size;
+    std::free(memory);
+}
+
+// Original flavor: every duck owns two freshly allocated behaviors.
+namespace allocatingDucks {
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly() = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        void fly() override{
+            std::cout << "I'm flying!!" << std::endl;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack() = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        void quack() override {
+            std::cout << "Quack" << std::endl;
+        }
+};
+
+class Duck{
+
+    public:
+        Duck(FlyBehavior* fb, QuackBehavior* qb) : m_flyBehavior(fb), m_quackBehavior(qb)
+        {
+
+        }
+
+        virtual ~Duck() = default;
+
+        virtual void display() = 0;
+
+    private:
+        std::unique_ptr<FlyBehavior> m_flyBehavior;
+        std::unique_ptr<QuackBehavior> m_quackBehavior;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        MallardDuck() : Duck(new FlyWithWings, new Quack)
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I'm a mallard duck" << std::endl;
+        }
+};
+
+} // namespace allocatingDucks
+
+namespace flyweightDucks {
+
+/* *********************************************
+* Shared behaviors. fly() and quack() are const and
+* each concrete behavior exposes a single instance,
+* so they can be referenced from any number of ducks.
+********************************************* */
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly() const = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        static const FlyWithWings& instance() {
+            static const FlyWithWings behavior;
+            return behavior;
+        }
+
+        void fly() const override{
+            std::cout << "I'm flying!!" << std::endl;
+        }
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        static const FlyNoWay& instance() {
+            static const FlyNoWay behavior;
+            return behavior;
+        }
+
+        void fly() const override{
+            std::cout << "I can't fly" << std::endl;
+        }
+};
+
+class FlyRocketPowered : public FlyBehavior
+{
+    public:
+        static const FlyRocketPowered& instance() {
+            static const FlyRocketPowered behavior;
+            return behavior;
+        }
+
+        void fly() const override{
+            std::cout << "I'm flying with a rocket!" << std::endl;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack() const = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        static const Quack& instance() {
+            static const Quack behavior;
+            return behavior;
+        }
+
+        void quack() const override {
+            std::cout << "Quack" << std::endl;
+        }
+};
+
+class MuteQuack : public QuackBehavior {
+    public:
+        static const MuteQuack& instance() {
+            static const MuteQuack behavior;
+            return behavior;
+        }
+
+        void quack() const override {
+            std::cout << "Silence" << std::endl;
+        }
+};
+
+class Squeak : public QuackBehavior {
+    public:
+        static const Squeak& instance() {
+            static const Squeak behavior;
+            return behavior;
+        }
+
+        void quack() const override{
+            std::cout << "Squeak" << std::endl;
+        }
+};
+
+/* *********************************************
+* Fixed size block pool. Memory is requested in
+* chunks of many slots, freed slots go to a free list
+* and are reused before a new chunk is requested.
+* Not thread safe: create and delete ducks on one thread.
+********************************************* */
+
+class DuckPool {
+
+    public:
+        static constexpr std::size_t slotSize = 32;
+        static constexpr std::size_t slotsPerChunk = 64 * 1024;
+
+        static DuckPool& instance() {
+            static DuckPool pool;
+            return pool;
+        }
+
+        DuckPool(const DuckPool&) = delete;
+        DuckPool& operator=(const DuckPool&) = delete;
+
+        void* allocate() {
+            if(m_freeList == nullptr)
+            {
+                grow();
+            }
+            Slot* slot = m_freeList;
+            m_freeList = slot->next;
+            ++m_slotsInUse;
+            return slot;
+        }
+
+        void deallocate(void* memory) {
+            Slot* slot = static_cast<Slot*>(memory);
+            slot->next = m_freeList;
+            m_freeList = slot;
+            --m_slotsInUse;
+        }
+
+        std::size_t chunks() const {
+            return m_chunks.size();
+        }
+
+        std::size_t slotsInUse() const {
+            return m_slotsInUse;
+        }
+
+    private:
+        union Slot {
+            Slot* next;
+            alignas(std::max_align_t) unsigned char storage[slotSize];
+        };
+
+        DuckPool() : m_chunks(), m_freeList(nullptr), m_slotsInUse(0)
+        {
+            m_chunks.reserve(64);
+        }
+
+        void grow() {
+            m_chunks.push_back(std::make_unique<Slot[]>(slotsPerChunk));
+            Slot* chunk = m_chunks.back().get();
+            for(std::size_t i = slotsPerChunk; i > 0; --i)
+            {
+                chunk[i - 1].next = m_freeList;
+                m_freeList = &chunk[i - 1];
+            }
+        }
+
+        std::vector<std::unique_ptr<Slot[]>> m_chunks;
+        Slot* m_freeList;
+        std::size_t m_slotsInUse;
+};
+
+class Duck{
+
+    public:
+        Duck(const FlyBehavior& fb, const QuackBehavior& qb) : m_flyBehavior(&fb), m_quackBehavior(&qb)
+        {
+
+        }
+
+        virtual ~Duck() = default;
+
+        Duck(const Duck&) = default;
+        Duck& operator=(const Duck&) = default;
+
+        // Ducks that fit in a pool slot come from the pool, larger ones from the heap.
+        static void* operator new(std::size_t size) {
+            if(size <= DuckPool::slotSize)
+            {
+                return DuckPool::instance().allocate();
+            }
+            return ::operator new(size);
+        }
+
+        static void operator delete(void* memory, std::size_t size) {
+            if(size <= DuckPool::slotSize)
+            {
+                DuckPool::instance().deallocate(memory);
+                return;
+            }
+            ::operator delete(memory);
+        }
+
+        virtual void display() = 0;
+
+        void performFly() {
+            m_flyBehavior->fly();
+        };
+
+        void performQuack() {
+            m_quackBehavior->quack();
+        };
+
+        void swim() {
+            std::cout << "All ducks float, even decoys!" << std::endl;
+        }
+
+        void setFlyBehavior(const FlyBehavior& fb) {
+            m_flyBehavior = &fb;
+        }
+
+        void setQuackBehavior(const QuackBehavior& qb) {
+            m_quackBehavior = &qb;
+        }
+
+    private:
+        const FlyBehavior* m_flyBehavior;
+        const QuackBehavior* m_quackBehavior;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        MallardDuck() : Duck(FlyWithWings::instance(), Quack::instance())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I'm a mallard duck" << std::endl;
+        }
+};
+
+class RedHeadDuck : public Duck {
+
+    public:
+        RedHeadDuck() : Duck(FlyWithWings::instance(), Quack::instance())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a red head duck" << std::endl;
+        }
+};
+
+class RubberDuck : public Duck {
+
+    public:
+        RubberDuck() : Duck(FlyNoWay::instance(), Squeak::instance())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a rubber duck" << std::endl;
+        }
+};
+
+class DecoyDuck : public Duck {
+
+    public:
+        DecoyDuck() : Duck(FlyNoWay::instance(), MuteQuack::instance())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a decoy duck" << std::endl;
+        }
+};
+
+class ModelDuck : public Duck {
+
+    public:
+        ModelDuck() : Duck(FlyNoWay::instance(), Quack::instance())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a model duck" << std::endl;
+        }
+};
+
+} // namespace flyweightDucks
+
+// Creates and destroys `count` ducks of type D and reports the allocations and time it took.
+template<typename D, typename Base>
+static void createDucks(const char* label, std::size_t count)
+{
+    std::vector<Base*> ducks;
+    ducks.reserve(count);
+
+    std::size_t allocationsBefore = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        ducks.push_back(new D());
+    }
+    for(auto duck : ducks)
+    {
+        delete duck;
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    std::size_t allocations = g_allocations - allocationsBefore;
+
+    std::cout << label << ": " << allocations << " allocations, "
+              << std::chrono::duration<double, std::milli>(stop - start).count() << " ms" << std::endl;
+}
+
+int main(void)
+{
+    using namespace flyweightDucks;
+
+    std::cout << "chapter 1 - strategy with flyweight behaviors and pooled ducks" << std::endl;
+
+    Duck* mallard = new MallardDuck();
+    Duck* redHead = new RedHeadDuck();
+    Duck* rubber = new RubberDuck();
+    Duck* decoy = new DecoyDuck();
+    Duck* model = new ModelDuck();
+
+    std::vector<Duck*> ducks = {mallard, redHead, rubber, decoy, model};
+
+    for(auto duck : ducks)
+    {
+        duck->display();
+        duck->performQuack();
+        duck->performFly();
+        std::cout << std::endl;
+    }
+
+    model->setFlyBehavior(FlyRocketPowered::instance());
+    model->performFly();
+    std::cout << std::endl;
+
+    for(auto duck : ducks)
+    {
+        delete duck;
+    }
+
+    /* *********************************************
+    * Allocation report: one million mallard ducks
+    * created and destroyed with each approach.
+    ********************************************* */
+
+    const std::size_t count = 1000000;
+
+    createDucks<allocatingDucks::MallardDuck, allocatingDucks::Duck>("owning behaviors, heap ducks  ", count);
+    createDucks<MallardDuck, Duck>("flyweight behaviors, pooled ducks", count);
+    // the pool is warm now, churning the same number of ducks needs no new chunk
+    createDucks<MallardDuck, Duck>("flyweight behaviors, warm pool   ", count);
+
+    std::cout << "pool chunks: " << DuckPool::instance().chunks()
+              << ", slots in use: " << DuckPool::instance().slotsInUse() << std::endl;
+}
@@ -0,0 +1,396 @@
+/* *********************************************
+* This example adds a spatial index to the ducks.
+* Neighborhood questions like "which ducks are near
+* this decoy" are O(n) per query on a plain list and
+* O(n^2) for the whole flock. A uniform grid, hashed
+* so the pond can be any size, answers them by looking
+* only at the cells around the query point.
+*
+* The grid is rebuilt every tick with a counting sort
+* into buffers that are reused, so a rebuild is O(n)
+* and allocates nothing once the flock size is stable.
+*
+* The program ends with a benchmark on one million
+* moving ducks.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <limits>
+
+class UniformGrid {
+
+    public:
+        struct Neighbor {
+            std::uint32_t duck;
+            float distanceSquared;
+        };
+
+        explicit UniformGrid(float cellSize) : m_cellSize(cellSize), m_inverseCellSize(1.0f / cellSize),
+            m_tableMask(0), m_cellStart(), m_entries(), m_duckBucket(), m_minCellX(0), m_maxCellX(0), m_minCellY(0), m_maxCellY(0)
+        {
+
+        }
+
+        float cellSize() const {
+            return m_cellSize;
+        }
+
+        // Sorts the ducks by bucket. Buffers only grow, so steady state ticks do not allocate.
+        void rebuild(const std::vector<float>& x, const std::vector<float>& y) {
+            const std::size_t count = x.size();
+            std::size_t tableSize = 1;
+            while(tableSize < count)
+            {
+                tableSize <<= 1;
+            }
+            m_tableMask = tableSize - 1;
+
+            m_cellStart.assign(tableSize + 1, 0);
+            m_duckBucket.resize(count);
+            m_entries.resize(count);
+
+            m_minCellX = m_minCellY = std::numeric_limits<std::int32_t>::max();
+            m_maxCellX = m_maxCellY = std::numeric_limits<std::int32_t>::min();
+
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                std::int32_t cellX = cellOf(x[i]);
+                std::int32_t cellY = cellOf(y[i]);
+                m_minCellX = std::min(m_minCellX, cellX);
+                m_maxCellX = std::max(m_maxCellX, cellX);
+                m_minCellY = std::min(m_minCellY, cellY);
+                m_maxCellY = std::max(m_maxCellY, cellY);
+
+                std::uint32_t bucket = bucketOf(cellX, cellY);
+                m_duckBucket[i] = bucket;
+                ++m_cellStart[bucket + 1];
+            }
+
+            for(std::size_t bucket = 1; bucket <= tableSize; ++bucket)
+            {
+                m_cellStart[bucket] += m_cellStart[bucket - 1];
+            }
+
+            // m_cellStart[bucket] is used as insertion cursor and ends up at the bucket end,
+            // shifting it back by one bucket restores the starts
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                std::uint32_t slot = m_cellStart[m_duckBucket[i]]++;
+                m_entries[slot] = Entry{x[i], y[i], cellOf(x[i]), cellOf(y[i]), static_cast<std::uint32_t>(i)};
+            }
+            for(std::size_t bucket = tableSize; bucket > 0; --bucket)
+            {
+                m_cellStart[bucket] = m_cellStart[bucket - 1];
+            }
+            m_cellStart[0] = 0;
+        }
+
+        // Reorders a per-duck array into grid order. Keeping the flock itself in that
+        // order makes the next rebuilds walk memory almost sequentially.
+        template<typename T>
+        void permute(std::vector<T>& values) const {
+            std::vector<T> ordered(values.size());
+            for(std::size_t slot = 0; slot < m_entries.size(); ++slot)
+            {
+                ordered[slot] = values[m_entries[slot].duck];
+            }
+            values.swap(ordered);
+        }
+
+        // Calls visit(duck, distanceSquared) for every duck within radius of (x, y).
+        template<typename Visitor>
+        void forEachInRadius(float x, float y, float radius, Visitor visit) const {
+            const float radiusSquared = radius * radius;
+            const std::int32_t firstX = cellOf(x - radius), lastX = cellOf(x + radius);
+            const std::int32_t firstY = cellOf(y - radius), lastY = cellOf(y + radius);
+
+            for(std::int32_t cellY = firstY; cellY <= lastY; ++cellY)
+            {
+                for(std::int32_t cellX = firstX; cellX <= lastX; ++cellX)
+                {
+                    visitCell(cellX, cellY, x, y, [&](std::uint32_t duck, float distanceSquared){
+                        if(distanceSquared <= radiusSquared)
+                        {
+                            visit(duck, distanceSquared);
+                        }
+                    });
+                }
+            }
+        }
+
+        // The k ducks closest to (x, y), nearest first.
+        void kNearest(float x, float y, std::size_t k, std::vector<Neighbor>& result) const {
+            auto farther = [](const Neighbor& left, const Neighbor& right){ return left.distanceSquared < right.distanceSquared; };
+            std::priority_queue<Neighbor, std::vector<Neighbor>, decltype(farther)> best(farther);
+
+            result.clear();
+            if(k == 0 || m_entries.empty())
+            {
+                return;
+            }
+
+            const std::int32_t centerX = cellOf(x);
+            const std::int32_t centerY = cellOf(y);
+            const std::int32_t maxRing = std::max({centerX - m_minCellX, m_maxCellX - centerX, centerY - m_minCellY, m_maxCellY - centerY});
+
+            auto consider = [&](std::uint32_t duck, float distanceSquared){
+                if(best.size() < k)
+                {
+                    best.push(Neighbor{duck, distanceSquared});
+                }
+                else if(distanceSquared < best.top().distanceSquared)
+                {
+                    best.pop();
+                    best.push(Neighbor{duck, distanceSquared});
+                }
+            };
+
+            // walk square rings of cells around the query cell until no closer duck can exist
+            for(std::int32_t ring = 0; ring <= maxRing; ++ring)
+            {
+                for(std::int32_t cellY = centerY - ring; cellY <= centerY + ring; ++cellY)
+                {
+                    const bool edgeRow = (cellY == centerY - ring) || (cellY == centerY + ring);
+                    const std::int32_t step = edgeRow ? 1 : 2 * ring;
+                    for(std::int32_t cellX = centerX - ring; cellX <= centerX + ring; cellX += step)
+                    {
+                        visitCell(cellX, cellY, x, y, consider);
+                    }
+                }
+
+                const float reach = static_cast<float>(ring) * m_cellSize;
+                if(best.size() == k && best.top().distanceSquared <= reach * reach)
+                {
+                    break;
+                }
+            }
+
+            while(!best.empty())
+            {
+                result.push_back(best.top());
+                best.pop();
+            }
+            std::reverse(result.begin(), result.end());
+        }
+
+    private:
+        // A duck copied into bucket order, everything a query touches sits in one cache line.
+        struct Entry {
+            float x;
+            float y;
+            std::int32_t cellX;
+            std::int32_t cellY;
+            std::uint32_t duck;
+        };
+
+        std::int32_t cellOf(float coordinate) const {
+            return static_cast<std::int32_t>(std::floor(coordinate * m_inverseCellSize));
+        }
+
+        std::uint32_t bucketOf(std::int32_t cellX, std::int32_t cellY) const {
+            std::uint32_t hash = static_cast<std::uint32_t>(cellX) * 73856093u ^ static_cast<std::uint32_t>(cellY) * 19349663u;
+            return hash & static_cast<std::uint32_t>(m_tableMask);
+        }
+
+        // Several cells can share a bucket, entries of other cells are skipped.
+        template<typename Visitor>
+        void visitCell(std::int32_t cellX, std::int32_t cellY, float x, float y, Visitor visit) const {
+            const std::uint32_t bucket = bucketOf(cellX, cellY);
+            for(std::uint32_t slot = m_cellStart[bucket]; slot < m_cellStart[bucket + 1]; ++slot)
+            {
+                const Entry& entry = m_entries[slot];
+                if(entry.cellX != cellX || entry.cellY != cellY)
+                {
+                    continue;
+                }
+                const float dx = entry.x - x;
+                const float dy = entry.y - y;
+                visit(entry.duck, dx * dx + dy * dy);
+            }
+        }
+
+        float m_cellSize;
+        float m_inverseCellSize;
+        std::size_t m_tableMask;
+        std::vector<std::uint32_t> m_cellStart;
+        std::vector<Entry> m_entries;
+        std::vector<std::uint32_t> m_duckBucket;
+        std::int32_t m_minCellX, m_maxCellX, m_minCellY, m_maxCellY;
+};
+
+// Positions of the flock on the pond, one array per coordinate, and the id of every duck.
+struct Pond {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<std::uint32_t> id;
+
+    Pond() : x(), y(), id()
+    {
+
+    }
+
+    std::size_t size() const {
+        return x.size();
+    }
+};
+
+static std::size_t bruteForceCount(const Pond& pond, float qx, float qy, float radius)
+{
+    std::size_t count = 0;
+    for(std::size_t i = 0; i < pond.size(); ++i)
+    {
+        const float dx = pond.x[i] - qx;
+        const float dy = pond.y[i] - qy;
+        if(dx * dx + dy * dy <= radius * radius)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+template<typename Function>
+static double measureMilliseconds(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main(void)
+{
+    std::cout << "chapter 1 - spatial index for duck neighbor queries" << std::endl;
+
+    std::mt19937 random(42);
+
+    {
+        Pond pond;
+        const char* names[] = {"mallard", "red head", "rubber", "model", "mallard 2"};
+        const float positions[][2] = {{1.0f, 1.0f}, {4.0f, 0.5f}, {12.0f, 3.0f}, {0.5f, -1.5f}, {-6.0f, 7.0f}};
+        for(const auto& position : positions)
+        {
+            pond.x.push_back(position[0]);
+            pond.y.push_back(position[1]);
+        }
+
+        UniformGrid grid(2.0f);
+        grid.rebuild(pond.x, pond.y);
+
+        std::cout << "ducks within 5 m of the decoy at (0, 0):" << std::endl;
+        grid.forEachInRadius(0.0f, 0.0f, 5.0f, [&](std::uint32_t duck, float distanceSquared){
+            std::cout << "  " << names[duck] << " at " << std::sqrt(distanceSquared) << " m" << std::endl;
+        });
+
+        std::vector<UniformGrid::Neighbor> nearest;
+        grid.kNearest(10.0f, 0.0f, 2, nearest);
+        std::cout << "two ducks closest to (10, 0):";
+        for(const auto& neighbor : nearest)
+        {
+            std::cout << " " << names[neighbor.duck];
+        }
+        std::cout << std::endl << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: one million ducks on a 2 km x 2 km
+    * pond, moving a little every tick. Each tick
+    * rebuilds the grid; queries are checked against
+    * brute force on a sample.
+    ********************************************* */
+
+    const std::size_t flockSize = 1000000;
+    const float pondSize = 2000.0f;
+    const float queryRadius = 5.0f;
+    const int ticks = 10;
+    const std::size_t radiusQueries = 100000;
+    const std::size_t nearestQueries = 10000;
+
+    Pond pond;
+    std::uniform_real_distribution<float> anywhere(0.0f, pondSize);
+    std::uniform_real_distribution<float> paddle(-0.5f, 0.5f);
+    for(std::size_t i = 0; i < flockSize; ++i)
+    {
+        pond.x.push_back(anywhere(random));
+        pond.y.push_back(anywhere(random));
+        pond.id.push_back(static_cast<std::uint32_t>(i));
+    }
+
+    UniformGrid grid(queryRadius);
+    double firstRebuildMs = measureMilliseconds([&](){ grid.rebuild(pond.x, pond.y); });
+
+    // store the flock in grid order once, ducks keep their identity through pond.id
+    grid.permute(pond.x);
+    grid.permute(pond.y);
+    grid.permute(pond.id);
+
+    double rebuildMs = 0.0;
+    double moveMs = 0.0;
+
+    for(int tick = 0; tick < ticks; ++tick)
+    {
+        moveMs += measureMilliseconds([&](){
+            for(std::size_t i = 0; i < flockSize; ++i)
+            {
+                pond.x[i] += paddle(random);
+                pond.y[i] += paddle(random);
+            }
+        });
+        rebuildMs += measureMilliseconds([&](){ grid.rebuild(pond.x, pond.y); });
+    }
+
+    std::vector<float> queryX(radiusQueries), queryY(radiusQueries);
+    for(std::size_t i = 0; i < radiusQueries; ++i)
+    {
+        queryX[i] = anywhere(random);
+        queryY[i] = anywhere(random);
+    }
+
+    std::size_t found = 0;
+    double radiusMs = measureMilliseconds([&](){
+        for(std::size_t i = 0; i < radiusQueries; ++i)
+        {
+            grid.forEachInRadius(queryX[i], queryY[i], queryRadius, [&found](std::uint32_t, float){ ++found; });
+        }
+    });
+
+    std::vector<UniformGrid::Neighbor> nearest;
+    nearest.reserve(8);
+    double nearestMs = measureMilliseconds([&](){
+        for(std::size_t i = 0; i < nearestQueries; ++i)
+        {
+            grid.kNearest(queryX[i], queryY[i], 8, nearest);
+        }
+    });
+
+    std::size_t mismatches = 0;
+    double bruteMs = measureMilliseconds([&](){
+        for(std::size_t i = 0; i < 20; ++i)
+        {
+            std::size_t expected = bruteForceCount(pond, queryX[i], queryY[i], queryRadius);
+            std::size_t actual = 0;
+            grid.forEachInRadius(queryX[i], queryY[i], queryRadius, [&actual](std::uint32_t, float){ ++actual; });
+            mismatches += expected != actual ? 1 : 0;
+        }
+    });
+
+    std::cout << "ducks: " << flockSize << ", cell size: " << grid.cellSize() << " m" << std::endl;
+    std::cout << "move ducks:      " << moveMs / ticks << " ms/tick" << std::endl;
+    std::cout << "first rebuild:   " << firstRebuildMs << " ms, flock in random order" << std::endl;
+    std::cout << "rebuild grid:    " << rebuildMs / ticks << " ms/tick, flock in grid order" << std::endl;
+    std::cout << "radius query:    " << radiusMs * 1e3 / radiusQueries << " us/query, "
+              << static_cast<double>(found) / radiusQueries << " ducks found on average" << std::endl;
+    std::cout << "8-nearest query: " << nearestMs * 1e3 / nearestQueries << " us/query" << std::endl;
+    std::cout << "brute force:     " << bruteMs / 20 << " ms/query, "
+              << mismatches << " mismatches against the grid" << std::endl;
+    std::cout << "all ducks querying their neighborhood once: grid "
+              << radiusMs / radiusQueries * flockSize / 1e3 << " s, brute force "
+              << bruteMs / 20 * flockSize / 1e3 << " s" << std::endl;
+}
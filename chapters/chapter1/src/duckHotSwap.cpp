@@ -0,0 +1,486 @@
+/* *********************************************
+* This example makes the STRATEGY design pattern
+* safe for live reconfiguration. Many worker threads
+* call performFly/performQuack while a control thread
+* swaps the behaviors of the same ducks.
+*
+* Behaviors are published through atomic pointers and
+* reclaimed with quiescent-state based RCU: readers only
+* do an atomic load, and from time to time announce that
+* they hold no behavior pointer (a quiescent state). An
+* old behavior is deleted once every online reader has
+* announced a quiescent state after the swap.
+*
+* The program ends with a benchmark of reader throughput
+* for different swap frequencies.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <cstdint>
+#include <stdexcept>
+
+/* *********************************************
+* RCU domain. Every reader thread owns a slot holding
+* the last epoch it has seen in a quiescent state, or
+* 0 while it is offline. Writers retire old objects
+* tagged with a new epoch, and they are freed once all
+* online readers have caught up with that epoch.
+********************************************* */
+
+class RcuDomain {
+
+    public:
+        class Reader;
+
+        static constexpr std::size_t maxReaders = 64;
+
+        RcuDomain() : m_epoch(1), m_slots(), m_slotUsed(), m_retired(), m_retiredMutex()
+        {
+            for(auto& slot : m_slots)
+            {
+                slot.epoch.store(0);
+            }
+            for(auto& used : m_slotUsed)
+            {
+                used.store(false);
+            }
+        }
+
+        ~RcuDomain() {
+            // readers are gone, everything can be freed
+            for(auto& retired : m_retired)
+            {
+                retired.deleter();
+            }
+        }
+
+        RcuDomain(const RcuDomain&) = delete;
+        RcuDomain& operator=(const RcuDomain&) = delete;
+
+        // Hands the object over to the domain, it is deleted after a grace period.
+        void retire(std::function<void()> deleter) {
+            std::uint64_t tag = m_epoch.fetch_add(1) + 1;
+            {
+                const std::lock_guard<std::mutex> lock(m_retiredMutex);
+                m_retired.push_back(Retired{tag, std::move(deleter)});
+            }
+            collect();
+        }
+
+        // Frees every retired object whose grace period has elapsed. Never blocks on readers.
+        std::size_t collect() {
+            std::uint64_t oldest = m_epoch.load();
+            for(std::size_t i = 0; i < maxReaders; ++i)
+            {
+                std::uint64_t seen = m_slots[i].epoch.load();
+                if(seen != 0)
+                {
+                    oldest = std::min(oldest, seen);
+                }
+            }
+
+            std::vector<Retired> expired;
+            {
+                const std::lock_guard<std::mutex> lock(m_retiredMutex);
+                auto firstAlive = std::partition(m_retired.begin(), m_retired.end(),
+                    [oldest](const Retired& retired){ return retired.tag <= oldest; });
+                std::move(m_retired.begin(), firstAlive, std::back_inserter(expired));
+                m_retired.erase(m_retired.begin(), firstAlive);
+            }
+
+            for(auto& retired : expired)
+            {
+                retired.deleter();
+            }
+            return expired.size();
+        }
+
+        std::size_t pending() {
+            const std::lock_guard<std::mutex> lock(m_retiredMutex);
+            return m_retired.size();
+        }
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<std::uint64_t> epoch;
+        };
+
+        struct Retired {
+            std::uint64_t tag;
+            std::function<void()> deleter;
+        };
+
+        std::atomic<std::uint64_t> m_epoch;
+        std::array<Slot, maxReaders> m_slots;
+        std::array<std::atomic<bool>, maxReaders> m_slotUsed;
+        std::vector<Retired> m_retired;
+        std::mutex m_retiredMutex;
+};
+
+// Registration of a reader thread. Online while it exists.
+class RcuDomain::Reader {
+
+    public:
+        explicit Reader(RcuDomain& domain) : m_domain(domain), m_slot(nullptr), m_index(0)
+        {
+            for(std::size_t i = 0; i < RcuDomain::maxReaders; ++i)
+            {
+                bool expected = false;
+                if(m_domain.m_slotUsed[i].compare_exchange_strong(expected, true))
+                {
+                    m_index = i;
+                    m_slot = &m_domain.m_slots[i];
+                    online();
+                    return;
+                }
+            }
+            throw std::runtime_error("too many RCU readers");
+        }
+
+        ~Reader() {
+            offline();
+            m_domain.m_slotUsed[m_index].store(false);
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // Announces that this thread holds no pointer to a behavior.
+        void quiescent() {
+            m_slot->epoch.store(m_domain.m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        // An offline reader does not hold back reclamation, use it before blocking.
+        void offline() {
+            m_slot->epoch.store(0, std::memory_order_release);
+        }
+
+        void online() {
+            m_slot->epoch.store(m_domain.m_epoch.load());
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+    private:
+        RcuDomain& m_domain;
+        RcuDomain::Slot* m_slot;
+        std::size_t m_index;
+};
+
+/* *********************************************
+* Behaviors. They are immutable once published, so
+* fly() and quack() are const and safe to call from
+* any number of threads. The distance/noise counters
+* belong to the calling thread.
+********************************************* */
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual const char* name() const = 0;
+        virtual void fly(std::uint64_t& distance) const = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I'm flying!!";
+        }
+        void fly(std::uint64_t& distance) const override{
+            distance += 1;
+        }
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I can't fly";
+        }
+        void fly(std::uint64_t& distance) const override{
+            (void)distance;
+        }
+};
+
+class FlyRocketPowered : public FlyBehavior
+{
+    public:
+        const char* name() const override{
+            return "I'm flying with a rocket!";
+        }
+        void fly(std::uint64_t& distance) const override{
+            distance += 10;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual const char* name() const = 0;
+        virtual void quack(std::uint64_t& noise) const = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        const char* name() const override {
+            return "Quack";
+        }
+        void quack(std::uint64_t& noise) const override {
+            noise += 1;
+        }
+};
+
+class MuteQuack : public QuackBehavior {
+    public:
+        const char* name() const override {
+            return "Silence";
+        }
+        void quack(std::uint64_t& noise) const override {
+            (void)noise;
+        }
+};
+
+class Squeak : public QuackBehavior {
+    public:
+        const char* name() const override{
+            return "Squeak";
+        }
+        void quack(std::uint64_t& noise) const override{
+            noise += 1;
+        }
+};
+
+class Duck{
+
+    public:
+        Duck(RcuDomain& domain, FlyBehavior* fb, QuackBehavior* qb) : m_domain(domain), m_flyBehavior(fb), m_quackBehavior(qb)
+        {
+
+        }
+
+        virtual ~Duck() {
+            delete m_flyBehavior.load();
+            delete m_quackBehavior.load();
+        }
+
+        Duck(const Duck&) = delete;
+        Duck& operator=(const Duck&) = delete;
+
+        virtual const char* display() const = 0;
+
+        // Wait-free for readers. The caller must be an online RcuDomain::Reader.
+        void performFly(std::uint64_t& distance) const {
+            m_flyBehavior.load(std::memory_order_acquire)->fly(distance);
+        };
+
+        void performQuack(std::uint64_t& noise) const {
+            m_quackBehavior.load(std::memory_order_acquire)->quack(noise);
+        };
+
+        const char* flyName() const {
+            return m_flyBehavior.load(std::memory_order_acquire)->name();
+        }
+
+        const char* quackName() const {
+            return m_quackBehavior.load(std::memory_order_acquire)->name();
+        }
+
+        // Publishes the new behavior, the old one is reclaimed after a grace period.
+        void setFlyBehavior(FlyBehavior* fb) {
+            if(fb != nullptr){
+                FlyBehavior* old = m_flyBehavior.exchange(fb);
+                m_domain.retire([old](){ delete old; });
+            }
+        }
+
+        void setQuackBehavior(QuackBehavior* qb) {
+            if(qb != nullptr)
+            {
+                QuackBehavior* old = m_quackBehavior.exchange(qb);
+                m_domain.retire([old](){ delete old; });
+            }
+        }
+
+    private:
+        RcuDomain& m_domain;
+        std::atomic<FlyBehavior*> m_flyBehavior;
+        std::atomic<QuackBehavior*> m_quackBehavior;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        explicit MallardDuck(RcuDomain& domain) : Duck(domain, new FlyWithWings, new Quack)
+        {
+
+        }
+
+        const char* display() const override {
+            return "I'm a mallard duck";
+        }
+};
+
+class ModelDuck : public Duck {
+
+    public:
+        explicit ModelDuck(RcuDomain& domain) : Duck(domain, new FlyNoWay, new Quack)
+        {
+
+        }
+
+        const char* display() const override {
+            return "I am a model duck";
+        }
+};
+
+struct BenchmarkResult {
+    double readsPerSecond;
+    std::uint64_t swaps;
+};
+
+// Runs `readers` threads over the flock for `duration` while the control
+// thread swaps the fly behavior of every duck each `swapInterval` (0: never).
+static BenchmarkResult runBenchmark(RcuDomain& domain, std::vector<std::unique_ptr<Duck>>& ducks,
+    std::size_t readers, std::chrono::microseconds swapInterval, std::chrono::milliseconds duration)
+{
+    std::atomic<bool> running(true);
+    std::atomic<std::uint64_t> totalReads(0);
+    std::vector<std::thread> threads;
+
+    for(std::size_t r = 0; r < readers; ++r)
+    {
+        threads.emplace_back([&](){
+            RcuDomain::Reader reader(domain);
+            std::uint64_t distance = 0;
+            std::uint64_t noise = 0;
+            std::uint64_t reads = 0;
+
+            while(running.load(std::memory_order_relaxed))
+            {
+                for(auto& duck : ducks)
+                {
+                    duck->performFly(distance);
+                    duck->performQuack(noise);
+                }
+                reads += ducks.size() * 2;
+                reader.quiescent();
+            }
+
+            totalReads += reads;
+        });
+    }
+
+    std::uint64_t swaps = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto stop = start + duration;
+
+    while(std::chrono::steady_clock::now() < stop)
+    {
+        if(swapInterval.count() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        for(auto& duck : ducks)
+        {
+            if(swaps % 2 == 0)
+            {
+                duck->setFlyBehavior(new FlyRocketPowered);
+            }
+            else
+            {
+                duck->setFlyBehavior(new FlyWithWings);
+            }
+        }
+        ++swaps;
+        std::this_thread::sleep_for(swapInterval);
+    }
+
+    running = false;
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    domain.collect();
+
+    return BenchmarkResult{static_cast<double>(totalReads.load()) / seconds, swaps};
+}
+
+int main(void)
+{
+    std::cout << "chapter 1 - strategy with thread-safe behavior swapping" << std::endl;
+
+    RcuDomain domain;
+
+    {
+        RcuDomain::Reader reader(domain);
+        MallardDuck mallard(domain);
+        ModelDuck model(domain);
+        std::uint64_t distance = 0;
+
+        for(const Duck* duck : {static_cast<const Duck*>(&mallard), static_cast<const Duck*>(&model)})
+        {
+            std::cout << duck->display() << std::endl;
+            std::cout << duck->quackName() << std::endl;
+            std::cout << duck->flyName() << std::endl;
+            std::cout << std::endl;
+        }
+
+        model.setFlyBehavior(new FlyRocketPowered);
+        std::cout << model.flyName() << std::endl;
+        model.performFly(distance);
+        std::cout << "retired behaviors waiting for a grace period: " << domain.pending() << std::endl;
+        reader.quiescent();
+        domain.collect();
+        std::cout << "after a quiescent state: " << domain.pending() << std::endl;
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: reader throughput while the control
+    * thread swaps behaviors at increasing rates.
+    ********************************************* */
+
+    const std::size_t flockSize = 256;
+    const std::size_t readers = std::max<std::size_t>(1, std::min<std::size_t>(8, std::thread::hardware_concurrency()));
+    const std::chrono::milliseconds duration(300);
+
+    std::vector<std::unique_ptr<Duck>> ducks;
+    for(std::size_t i = 0; i < flockSize; ++i)
+    {
+        ducks.push_back(std::make_unique<MallardDuck>(domain));
+    }
+
+    std::cout << "readers: " << readers << ", ducks: " << flockSize << std::endl;
+
+    for(long interval : {0L, 10000L, 1000L, 100L})
+    {
+        BenchmarkResult result = runBenchmark(domain, ducks, readers, std::chrono::microseconds(interval), duration);
+        if(interval == 0)
+        {
+            std::cout << "no swaps: ";
+        }
+        else
+        {
+            std::cout << "swap every " << interval << " us: ";
+        }
+        std::cout
+                  << result.readsPerSecond / 1e6 << " M calls/s, "
+                  << result.swaps * flockSize << " behaviors swapped, "
+                  << domain.pending() << " awaiting reclamation" << std::endl;
+    }
+}
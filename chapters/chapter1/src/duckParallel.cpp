@@ -0,0 +1,422 @@
+/* *********************************************
+* This example runs the STRATEGY based ducks on
+* all cores. A flock tick is split into fixed size
+* chunks that a thread pool works through, and every
+* chunk writes its partial results into its own slot.
+* The partials are reduced in chunk order afterwards.
+*
+* The partitioning does not depend on the number of
+* threads and floating point sums are always added up
+* in the same order, so the results are bit-identical
+* for any thread count.
+*
+* The program ends with a scaling curve from one to
+* all hardware threads.
+*
+* Usage: chapter1_9 [max threads]
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+struct DuckState {
+    float altitude;
+    float velocity;
+    std::uint32_t quacks;
+};
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly(DuckState& state, float dt) const = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        void fly(DuckState& state, float dt) const override{
+            state.velocity += (2.0f - 0.5f * state.velocity) * dt;
+            state.altitude += state.velocity * dt;
+        }
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        void fly(DuckState& state, float dt) const override{
+            (void)state;
+            (void)dt;
+        }
+};
+
+class FlyRocketPowered : public FlyBehavior
+{
+    public:
+        void fly(DuckState& state, float dt) const override{
+            state.velocity += (20.0f - 0.1f * state.velocity) * dt;
+            state.altitude += state.velocity * dt;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack(DuckState& state) const = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        void quack(DuckState& state) const override {
+            ++state.quacks;
+        }
+};
+
+class MuteQuack : public QuackBehavior {
+    public:
+        void quack(DuckState& state) const override {
+            (void)state;
+        }
+};
+
+class Squeak : public QuackBehavior {
+    public:
+        void quack(DuckState& state) const override{
+            state.quacks += 2;
+        }
+};
+
+// Behaviors are stateless and shared by all ducks.
+static const FlyWithWings flyWithWings;
+static const FlyNoWay flyNoWay;
+static const FlyRocketPowered flyRocketPowered;
+static const Quack quack;
+static const MuteQuack muteQuack;
+static const Squeak squeak;
+
+class Duck{
+
+    public:
+        Duck(const FlyBehavior* fb, const QuackBehavior* qb) : m_flyBehavior(fb), m_quackBehavior(qb), m_state{0.0f, 0.0f, 0}
+        {
+
+        }
+
+        void performFly(float dt) {
+            m_flyBehavior->fly(m_state, dt);
+        };
+
+        void performQuack() {
+            m_quackBehavior->quack(m_state);
+        };
+
+        void setFlyBehavior(const FlyBehavior* fb) {
+            if(fb != nullptr){
+                m_flyBehavior = fb;
+            }
+        }
+
+        const DuckState& state() const {
+            return m_state;
+        }
+
+    private:
+        const FlyBehavior* m_flyBehavior;
+        const QuackBehavior* m_quackBehavior;
+        DuckState m_state;
+
+};
+
+/* *********************************************
+* Minimal thread pool. run() hands out task indices
+* from an atomic counter to the workers and to the
+* calling thread, and returns when all are done. Which
+* thread runs a task does not matter for the results.
+********************************************* */
+
+class ThreadPool {
+
+    public:
+        explicit ThreadPool(std::size_t threads) : m_workers(), m_mutex(), m_wake(), m_done(),
+            m_task(), m_taskCount(0), m_nextTask(0), m_finishedTasks(0), m_activeWorkers(0), m_generation(0), m_stop(false)
+        {
+            for(std::size_t i = 1; i < threads; ++i)
+            {
+                m_workers.emplace_back([this](){ workerLoop(); });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                const std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for(auto& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        std::size_t size() const {
+            return m_workers.size() + 1;
+        }
+
+        void run(std::size_t taskCount, std::function<void(std::size_t)> task) {
+            {
+                // a worker that woke up late may still be looking at the previous task
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this](){ return m_activeWorkers == 0; });
+                m_task = std::move(task);
+                m_taskCount = taskCount;
+                m_nextTask = 0;
+                m_finishedTasks = 0;
+                ++m_generation;
+            }
+            m_wake.notify_all();
+
+            std::size_t finished = work();
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_finishedTasks += finished;
+            m_done.wait(lock, [this](){ return m_finishedTasks == m_taskCount && m_activeWorkers == 0; });
+        }
+
+    private:
+        void workerLoop() {
+            std::uint64_t seenGeneration = 0;
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_wake.wait(lock, [&](){ return m_stop || m_generation != seenGeneration; });
+                    if(m_stop)
+                    {
+                        return;
+                    }
+                    seenGeneration = m_generation;
+                    ++m_activeWorkers;
+                }
+
+                std::size_t finished = work();
+
+                {
+                    const std::lock_guard<std::mutex> lock(m_mutex);
+                    m_finishedTasks += finished;
+                    --m_activeWorkers;
+                }
+                m_done.notify_all();
+            }
+        }
+
+        // Runs tasks until none is left, returns how many this thread ran.
+        std::size_t work() {
+            std::size_t finished = 0;
+            for(std::size_t index = m_nextTask++; index < m_taskCount; index = m_nextTask++)
+            {
+                m_task(index);
+                ++finished;
+            }
+            return finished;
+        }
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        std::function<void(std::size_t)> m_task;
+        std::size_t m_taskCount;
+        std::atomic<std::size_t> m_nextTask;
+        std::size_t m_finishedTasks;
+        std::size_t m_activeWorkers;
+        std::uint64_t m_generation;
+        bool m_stop;
+};
+
+struct FlockSummary {
+    double totalAltitude;
+    std::uint64_t totalQuacks;
+    float maxAltitude;
+};
+
+/* *********************************************
+* Parallel flock. The chunk size is a constant, never
+* derived from the thread count, and the reduction
+* walks the chunk partials in index order.
+********************************************* */
+
+class ParallelFlock {
+
+    public:
+        static constexpr std::size_t chunkSize = 16 * 1024;
+
+        explicit ParallelFlock(std::vector<Duck> ducks) : m_ducks(std::move(ducks)), m_partials()
+        {
+            m_partials.resize((m_ducks.size() + chunkSize - 1) / chunkSize);
+        }
+
+        FlockSummary tick(ThreadPool& pool, float dt) {
+            pool.run(m_partials.size(), [this, dt](std::size_t chunk){
+                const std::size_t begin = chunk * chunkSize;
+                const std::size_t end = std::min(begin + chunkSize, m_ducks.size());
+                FlockSummary partial{0.0, 0, 0.0f};
+
+                for(std::size_t i = begin; i < end; ++i)
+                {
+                    m_ducks[i].performFly(dt);
+                    m_ducks[i].performQuack();
+
+                    const DuckState& state = m_ducks[i].state();
+                    partial.totalAltitude += static_cast<double>(state.altitude);
+                    partial.totalQuacks += state.quacks;
+                    partial.maxAltitude = std::max(partial.maxAltitude, state.altitude);
+                }
+
+                m_partials[chunk] = partial;
+            });
+
+            FlockSummary summary{0.0, 0, 0.0f};
+            for(const auto& partial : m_partials)
+            {
+                summary.totalAltitude += partial.totalAltitude;
+                summary.totalQuacks += partial.totalQuacks;
+                summary.maxAltitude = std::max(summary.maxAltitude, partial.maxAltitude);
+            }
+            return summary;
+        }
+
+        std::size_t size() const {
+            return m_ducks.size();
+        }
+
+    private:
+        std::vector<Duck> m_ducks;
+        std::vector<FlockSummary> m_partials;
+};
+
+static std::vector<Duck> makeFlock(std::size_t count)
+{
+    std::vector<Duck> ducks;
+    ducks.reserve(count);
+
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        switch(i % 5)
+        {
+            case 0:
+            case 1:
+                ducks.emplace_back(&flyWithWings, &quack);
+                break;
+            case 2:
+                ducks.emplace_back(&flyNoWay, &squeak);
+                break;
+            case 3:
+                ducks.emplace_back(&flyNoWay, &muteQuack);
+                break;
+            default:
+                ducks.emplace_back(&flyNoWay, &quack);
+                ducks.back().setFlyBehavior(&flyRocketPowered);
+                break;
+        }
+    }
+    return ducks;
+}
+
+static bool sameBits(const FlockSummary& left, const FlockSummary& right)
+{
+    return std::memcmp(&left.totalAltitude, &right.totalAltitude, sizeof(double)) == 0
+        && left.totalQuacks == right.totalQuacks
+        && std::memcmp(&left.maxAltitude, &right.maxAltitude, sizeof(float)) == 0;
+}
+
+// more threads than this is a typo, not a machine
+static constexpr std::size_t maxThreadsLimit = 1024;
+
+// A decimal count in [1, limit], digits only: strtoul alone would take blanks and a sign.
+static bool parseCount(const char* text, std::size_t limit, std::size_t& value)
+{
+    if(!std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long parsed = std::strtoul(text, &end, 10);
+    if(*end != '\0' || errno != 0 || parsed == 0 || parsed > limit)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "chapter 1 - strategy with a parallel, deterministic flock tick" << std::endl;
+
+    const std::size_t flockSize = 2000000;
+    const int ticks = 20;
+    const float dt = 1.0f / 60.0f;
+    // the top of the curve defaults to the hardware threads, the first argument overrides it
+    std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    if(argc > 2 || (argc == 2 && !parseCount(argv[1], maxThreadsLimit, maxThreads)))
+    {
+        std::cerr << "usage: " << argv[0] << " [max threads]" << std::endl;
+        return 1;
+    }
+
+    std::cout << "ducks: " << flockSize << ", ticks: " << ticks
+              << ", chunk size: " << ParallelFlock::chunkSize << std::endl;
+
+    FlockSummary reference{0.0, 0, 0.0f};
+    double singleThreadSeconds = 0.0;
+
+    std::vector<std::size_t> threadCounts;
+    for(std::size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    for(std::size_t threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        ParallelFlock flock(makeFlock(flockSize));
+        FlockSummary summary{0.0, 0, 0.0f};
+
+        auto start = std::chrono::steady_clock::now();
+        for(int tick = 0; tick < ticks; ++tick)
+        {
+            summary = flock.tick(pool, dt);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count();
+
+        if(threads == 1)
+        {
+            reference = summary;
+            singleThreadSeconds = seconds;
+            std::cout << "total altitude " << summary.totalAltitude << ", quacks " << summary.totalQuacks
+                      << ", highest duck " << summary.maxAltitude << std::endl;
+        }
+
+        std::cout << threads << " threads: " << seconds * 1e3 << " ms, speedup "
+                  << singleThreadSeconds / seconds << "x, "
+                  << (sameBits(summary, reference) ? "bit-identical" : "RESULTS DIFFER") << std::endl;
+    }
+}
@@ -0,0 +1,525 @@
+/* *********************************************
+* This example stores a whole flock of ducks in a
+* versioned binary snapshot that is loaded with mmap.
+* The snapshot holds the same structure-of-arrays data
+* the flock works on (duck kinds, behavior ids and
+* state), each section aligned in the file, so after
+* mapping the ducks are used in place: no per-duck
+* construction and no allocation at startup.
+*
+* The program checks a save/load round trip, rejects
+* damaged files, and compares startup times.
+*
+* Usage: chapter1_11 [snapshot file]
+********************************************* */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <iterator>
+#include <array>
+#include <vector>
+#include <list>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class FlyBehaviorId : std::uint8_t { FlyWithWings, FlyNoWay, FlyRocketPowered, Count };
+enum class QuackBehaviorId : std::uint8_t { Quack, MuteQuack, Squeak, Count };
+enum class DuckKind : std::uint8_t { Mallard, RedHead, Rubber, Decoy, Model, Count };
+
+struct DuckState {
+    float altitude;
+    std::uint32_t quacks;
+};
+
+/* *********************************************
+* A flock as plain arrays. FlockView does not own
+* the memory: it points either into the vectors of a
+* DuckFlock or straight into a mapped snapshot.
+********************************************* */
+
+struct FlockView {
+    std::size_t size;
+    DuckKind* kinds;
+    FlyBehaviorId* flyBehaviors;
+    QuackBehaviorId* quackBehaviors;
+    DuckState* states;
+
+    void performFly() const {
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            switch(flyBehaviors[i])
+            {
+                case FlyBehaviorId::FlyWithWings:
+                    states[i].altitude += 1.0f;
+                    break;
+                case FlyBehaviorId::FlyRocketPowered:
+                    states[i].altitude += 10.0f;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    void performQuack() const {
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            if(quackBehaviors[i] != QuackBehaviorId::MuteQuack)
+            {
+                ++states[i].quacks;
+            }
+        }
+    }
+
+    void display(std::size_t duck) const {
+        static constexpr std::array<const char*, static_cast<std::size_t>(DuckKind::Count)> descriptions = {
+            "I'm a mallard duck", "I am a red head duck", "I am a rubber duck",
+            "I am a decoy duck", "I am a model duck"};
+        std::cout << descriptions[static_cast<std::size_t>(kinds[duck])] << std::endl;
+    }
+};
+
+class DuckFlock {
+
+    public:
+        DuckFlock() : m_kinds(), m_flyBehaviors(), m_quackBehaviors(), m_states()
+        {
+
+        }
+
+        void add(DuckKind kind, FlyBehaviorId fb, QuackBehaviorId qb) {
+            m_kinds.push_back(kind);
+            m_flyBehaviors.push_back(fb);
+            m_quackBehaviors.push_back(qb);
+            m_states.push_back(DuckState{0.0f, 0});
+        }
+
+        FlockView view() {
+            return FlockView{m_kinds.size(), m_kinds.data(), m_flyBehaviors.data(), m_quackBehaviors.data(), m_states.data()};
+        }
+
+    private:
+        std::vector<DuckKind> m_kinds;
+        std::vector<FlyBehaviorId> m_flyBehaviors;
+        std::vector<QuackBehaviorId> m_quackBehaviors;
+        std::vector<DuckState> m_states;
+};
+
+/* *********************************************
+* Snapshot file layout, version 1. All integers are
+* in the byte order of the writing host; the header
+* carries a byte order mark and the layout sizes so a
+* file from an incompatible build is rejected.
+*
+*   header (64 bytes)
+*   kinds           uint8  [count]  at kindsOffset
+*   fly behaviors   uint8  [count]  at flyOffset
+*   quack behaviors uint8  [count]  at quackOffset
+*   states          DuckState[count] at statesOffset
+*
+* Every section starts on a 64 byte boundary.
+********************************************* */
+
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t stateSize;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::uint64_t kindsOffset;
+    std::uint64_t flyOffset;
+    std::uint64_t quackOffset;
+    std::uint64_t statesOffset;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+
+static constexpr char snapshotMagic[8] = {'D', 'U', 'C', 'K', 'F', 'L', 'C', 'K'};
+static constexpr std::uint32_t snapshotVersion = 1;
+static constexpr std::uint32_t snapshotByteOrder = 0x01020304;
+static constexpr std::uint64_t sectionAlignment = 64;
+
+static std::uint64_t alignUp(std::uint64_t offset)
+{
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+static void saveSnapshot(const FlockView& flock, const std::string& path)
+{
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.byteOrder = snapshotByteOrder;
+    header.stateSize = sizeof(DuckState);
+    header.count = flock.size;
+    header.kindsOffset = alignUp(sizeof(SnapshotHeader));
+    header.flyOffset = alignUp(header.kindsOffset + flock.size);
+    header.quackOffset = alignUp(header.flyOffset + flock.size);
+    header.statesOffset = alignUp(header.quackOffset + flock.size);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    auto writeAt = [&out](std::uint64_t offset, const void* data, std::size_t bytes){
+        static const char padding[sectionAlignment] = {};
+        std::uint64_t position = static_cast<std::uint64_t>(out.tellp());
+        out.write(padding, static_cast<std::streamsize>(offset - position));
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeAt(header.kindsOffset, flock.kinds, flock.size);
+    writeAt(header.flyOffset, flock.flyBehaviors, flock.size);
+    writeAt(header.quackOffset, flock.quackBehaviors, flock.size);
+    writeAt(header.statesOffset, flock.states, flock.size * sizeof(DuckState));
+
+    if(!out)
+    {
+        throw std::runtime_error("could not write snapshot " + path);
+    }
+}
+
+/* *********************************************
+* A snapshot mapped into memory. The mapping is
+* private and writable: ducks can fly and quack in
+* place, changes stay in this process and never reach
+* the file (copy on write).
+********************************************* */
+
+class MappedFlock {
+
+    public:
+        explicit MappedFlock(const std::string& path) : m_data(nullptr), m_length(0), m_view()
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0)
+            {
+                throw std::runtime_error("could not open snapshot " + path);
+            }
+
+            struct stat info{};
+            if(::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+            {
+                ::close(fd);
+                throw std::runtime_error("snapshot too small: " + path);
+            }
+
+            m_length = static_cast<std::size_t>(info.st_size);
+            void* data = ::mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(data == MAP_FAILED)
+            {
+                throw std::runtime_error("could not map snapshot " + path);
+            }
+            m_data = static_cast<unsigned char*>(data);
+
+            try
+            {
+                m_view = validate();
+            }
+            catch(...)
+            {
+                ::munmap(m_data, m_length);
+                throw;
+            }
+            // ducks are about to be visited front to back
+            ::madvise(m_data, m_length, MADV_SEQUENTIAL);
+        }
+
+        ~MappedFlock() {
+            ::munmap(m_data, m_length);
+        }
+
+        MappedFlock(const MappedFlock&) = delete;
+        MappedFlock& operator=(const MappedFlock&) = delete;
+
+        const FlockView& view() const {
+            return m_view;
+        }
+
+    private:
+        FlockView validate() const {
+            SnapshotHeader header;
+            std::memcpy(&header, m_data, sizeof(header));
+
+            if(std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0)
+            {
+                throw std::runtime_error("not a flock snapshot");
+            }
+            if(header.version != snapshotVersion)
+            {
+                throw std::runtime_error("unsupported snapshot version " + std::to_string(header.version));
+            }
+            if(header.byteOrder != snapshotByteOrder || header.stateSize != sizeof(DuckState))
+            {
+                throw std::runtime_error("snapshot written by an incompatible build");
+            }
+
+            const std::uint64_t count = header.count;
+            auto fits = [this, count](std::uint64_t offset, std::uint64_t elementSize){
+                return offset % sectionAlignment == 0 && offset <= m_length
+                    && count <= (m_length - offset) / elementSize;
+            };
+            if(!fits(header.kindsOffset, 1) || !fits(header.flyOffset, 1)
+                || !fits(header.quackOffset, 1) || !fits(header.statesOffset, sizeof(DuckState)))
+            {
+                throw std::runtime_error("snapshot truncated or corrupt");
+            }
+
+            // the states are written through the mapping, so no section may overlap the header or another one
+            const std::uint64_t sections[4][2] = {
+                {header.kindsOffset, count}, {header.flyOffset, count},
+                {header.quackOffset, count}, {header.statesOffset, count * sizeof(DuckState)}};
+            for(std::size_t i = 0; i < 4; ++i)
+            {
+                if(sections[i][0] < alignUp(sizeof(SnapshotHeader)))
+                {
+                    throw std::runtime_error("snapshot section overlaps the header");
+                }
+                for(std::size_t j = i + 1; j < 4; ++j)
+                {
+                    if(sections[i][0] < sections[j][0] + sections[j][1] && sections[j][0] < sections[i][0] + sections[i][1])
+                    {
+                        throw std::runtime_error("snapshot sections overlap");
+                    }
+                }
+            }
+
+            FlockView view{static_cast<std::size_t>(count),
+                reinterpret_cast<DuckKind*>(m_data + header.kindsOffset),
+                reinterpret_cast<FlyBehaviorId*>(m_data + header.flyOffset),
+                reinterpret_cast<QuackBehaviorId*>(m_data + header.quackOffset),
+                reinterpret_cast<DuckState*>(static_cast<void*>(m_data + header.statesOffset))};
+
+            for(std::size_t i = 0; i < view.size; ++i)
+            {
+                if(view.kinds[i] >= DuckKind::Count || view.flyBehaviors[i] >= FlyBehaviorId::Count
+                    || view.quackBehaviors[i] >= QuackBehaviorId::Count)
+                {
+                    throw std::runtime_error("snapshot contains an unknown duck or behavior");
+                }
+            }
+            return view;
+        }
+
+        unsigned char* m_data;
+        std::size_t m_length;
+        FlockView m_view;
+};
+
+/* *********************************************
+* Classic ducks, to measure what startup costs when
+* every duck is constructed with its behaviors.
+********************************************* */
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly(DuckState& state) = 0;
+};
+
+class FlyWithWings : public FlyBehavior {
+    public:
+        void fly(DuckState& state) override {
+            state.altitude += 1.0f;
+        }
+};
+
+class FlyNoWay : public FlyBehavior {
+    public:
+        void fly(DuckState& state) override {
+            (void)state;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack(DuckState& state) = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        void quack(DuckState& state) override {
+            ++state.quacks;
+        }
+};
+
+class Duck {
+
+    public:
+        Duck(FlyBehavior* fb, QuackBehavior* qb) : m_flyBehavior(fb), m_quackBehavior(qb), m_state{0.0f, 0}
+        {
+
+        }
+
+    private:
+        std::unique_ptr<FlyBehavior> m_flyBehavior;
+        std::unique_ptr<QuackBehavior> m_quackBehavior;
+        DuckState m_state;
+};
+
+static bool sameFlock(const FlockView& left, const FlockView& right)
+{
+    return left.size == right.size
+        && std::memcmp(left.kinds, right.kinds, left.size) == 0
+        && std::memcmp(left.flyBehaviors, right.flyBehaviors, left.size) == 0
+        && std::memcmp(left.quackBehaviors, right.quackBehaviors, left.size) == 0
+        && std::memcmp(left.states, right.states, left.size * sizeof(DuckState)) == 0;
+}
+
+static bool loadFails(const std::string& path)
+{
+    try
+    {
+        MappedFlock flock(path);
+    }
+    catch(const std::runtime_error& error)
+    {
+        std::cout << "  rejected: " << error.what() << std::endl;
+        return true;
+    }
+    return false;
+}
+
+template<typename Function>
+static double measureMilliseconds(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "chapter 1 - memory-mapped flock snapshots" << std::endl;
+
+    const std::string path = argc > 1 ? argv[1] : "flock.snapshot";
+    const std::size_t flockSize = 1000000;
+
+    DuckFlock flock;
+    for(std::size_t i = 0; i < flockSize; ++i)
+    {
+        switch(i % 5)
+        {
+            case 0: flock.add(DuckKind::Mallard, FlyBehaviorId::FlyWithWings, QuackBehaviorId::Quack); break;
+            case 1: flock.add(DuckKind::RedHead, FlyBehaviorId::FlyWithWings, QuackBehaviorId::Quack); break;
+            case 2: flock.add(DuckKind::Rubber, FlyBehaviorId::FlyNoWay, QuackBehaviorId::Squeak); break;
+            case 3: flock.add(DuckKind::Decoy, FlyBehaviorId::FlyNoWay, QuackBehaviorId::MuteQuack); break;
+            default: flock.add(DuckKind::Model, FlyBehaviorId::FlyRocketPowered, QuackBehaviorId::Quack); break;
+        }
+    }
+    flock.view().performFly();
+    flock.view().performQuack();
+
+    double saveMs = measureMilliseconds([&](){ saveSnapshot(flock.view(), path); });
+
+    /* *********************************************
+    * Round trip: the mapped flock must match the
+    * saved one byte for byte, and behave the same.
+    ********************************************* */
+
+    bool roundTrip = false;
+    {
+        MappedFlock mapped(path);
+        roundTrip = sameFlock(mapped.view(), flock.view());
+        for(std::size_t duck = 0; duck < 5; ++duck)
+        {
+            mapped.view().display(duck);
+        }
+
+        mapped.view().performFly();
+        flock.view().performFly();
+        roundTrip = roundTrip && sameFlock(mapped.view(), flock.view());
+    }
+    std::cout << "round trip: " << (roundTrip ? "ok" : "FAILED") << std::endl;
+
+    // a private mapping never writes back, the file still holds the saved flock
+    {
+        MappedFlock mapped(path);
+        std::cout << "file unchanged by flying ducks: " << std::boolalpha
+                  << (mapped.view().states[0].altitude == 1.0f) << std::endl;
+    }
+
+    std::cout << "damaged snapshots:" << std::endl;
+    const std::string damaged = path + ".damaged";
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        std::vector<char> wrongVersion = bytes;
+        wrongVersion[8] = 99;
+        std::ofstream(damaged, std::ios::binary).write(wrongVersion.data(), static_cast<std::streamsize>(wrongVersion.size()));
+        bool versionRejected = loadFails(damaged);
+
+        std::ofstream(damaged, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size() / 2));
+        bool truncationRejected = loadFails(damaged);
+
+        SnapshotHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        std::vector<char> badBehavior = bytes;
+        badBehavior[header.flyOffset + 3] = 42;
+        std::ofstream(damaged, std::ios::binary).write(badBehavior.data(), static_cast<std::streamsize>(badBehavior.size()));
+        bool behaviorRejected = loadFails(damaged);
+
+        // states laid over the kinds: flying would overwrite the duck kinds and behaviors
+        std::vector<char> overlapping = bytes;
+        SnapshotHeader overlap = header;
+        overlap.statesOffset = header.kindsOffset;
+        std::memcpy(overlapping.data(), &overlap, sizeof(overlap));
+        std::ofstream(damaged, std::ios::binary).write(overlapping.data(), static_cast<std::streamsize>(overlapping.size()));
+        bool overlapRejected = loadFails(damaged);
+
+        std::vector<char> intoHeader = bytes;
+        SnapshotHeader zero = header;
+        zero.kindsOffset = 0;
+        std::memcpy(intoHeader.data(), &zero, sizeof(zero));
+        std::ofstream(damaged, std::ios::binary).write(intoHeader.data(), static_cast<std::streamsize>(intoHeader.size()));
+        bool headerRejected = loadFails(damaged);
+
+        std::cout << "all rejected: " << (versionRejected && truncationRejected && behaviorRejected && overlapRejected && headerRejected) << std::endl;
+    }
+    std::remove(damaged.c_str());
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Startup benchmark: constructing one million
+    * classic ducks against mapping the snapshot and
+    * running the first tick on it.
+    ********************************************* */
+
+    double constructMs = measureMilliseconds([&](){
+        std::list<std::unique_ptr<Duck>> ducks;
+        for(std::size_t i = 0; i < flockSize; ++i)
+        {
+            ducks.push_back(std::make_unique<Duck>(new FlyWithWings, new Quack));
+        }
+    });
+
+    double mapMs = 0.0;
+    double firstTickMs = 0.0;
+    {
+        std::unique_ptr<MappedFlock> mapped;
+        mapMs = measureMilliseconds([&](){ mapped = std::make_unique<MappedFlock>(path); });
+        firstTickMs = measureMilliseconds([&](){
+            mapped->view().performFly();
+            mapped->view().performQuack();
+        });
+    }
+
+    std::cout << "ducks: " << flockSize << std::endl;
+    std::cout << "save snapshot:              " << saveMs << " ms" << std::endl;
+    std::cout << "construct classic ducks:    " << constructMs << " ms (destruction included)" << std::endl;
+    std::cout << "map and validate snapshot:  " << mapMs << " ms" << std::endl;
+    std::cout << "first tick on mapped flock: " << firstTickMs << " ms" << std::endl;
+}
@@ -0,0 +1,390 @@
+/* *********************************************
+* This example implements the STRATEGY
+* design pattern with static dispatch. The family
+* of algorithms is closed and stored by value in a
+* std::variant, so calling a behavior is a std::visit
+* instead of a pointer chase and a virtual call.
+* Behaviors can still be swapped at runtime.
+*
+* The program ends with a benchmark comparing the
+* virtual and the variant flavor of Duck.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <variant>
+#include <vector>
+#include <memory>
+
+// Original flavor: behaviors behind owning pointers and virtual calls.
+namespace virtualDispatch {
+
+class FlyBehavior {
+    public:
+        virtual ~FlyBehavior() = default;
+        virtual void fly(std::ostream& out) = 0;
+};
+
+class FlyWithWings : public FlyBehavior
+{
+    public:
+        void fly(std::ostream& out) override{
+            if(out) out << "I'm flying!!" << std::endl;
+        }
+};
+
+class FlyNoWay : public FlyBehavior
+{
+    public:
+        void fly(std::ostream& out) override{
+            if(out) out << "I can't fly" << std::endl;
+        }
+};
+
+class FlyRocketPowered : public FlyBehavior
+{
+    public:
+        void fly(std::ostream& out) override{
+            if(out) out << "I'm flying with a rocket!" << std::endl;
+        }
+};
+
+class QuackBehavior {
+    public:
+        virtual ~QuackBehavior() = default;
+        virtual void quack(std::ostream& out) = 0;
+};
+
+class Quack : public QuackBehavior {
+    public:
+        void quack(std::ostream& out) override {
+            if(out) out << "Quack" << std::endl;
+        }
+};
+
+class MuteQuack : public QuackBehavior {
+    public:
+        void quack(std::ostream& out) override {
+            if(out) out << "Silence" << std::endl;
+        }
+};
+
+class Squeak : public QuackBehavior {
+    public:
+        void quack(std::ostream& out) override{
+            if(out) out << "Squeak" << std::endl;
+        }
+};
+
+class Duck{
+
+    public:
+        Duck(FlyBehavior* fb, QuackBehavior* qb) : m_flyBehavior(fb), m_quackBehavior(qb)
+        {
+
+        }
+
+        virtual ~Duck() = default;
+
+        virtual void display() = 0;
+
+        void performFly(std::ostream& out = std::cout) {
+            m_flyBehavior->fly(out);
+        };
+
+        void performQuack(std::ostream& out = std::cout) {
+            m_quackBehavior->quack(out);
+        };
+
+        void setFlyBehavior(FlyBehavior* fb) {
+            if(fb != nullptr){
+                m_flyBehavior.reset(fb);
+            }
+        }
+
+        void setQuackBehavior(QuackBehavior* qb) {
+            if(qb != nullptr)
+            {
+                m_quackBehavior.reset(qb);
+            }
+        }
+
+    private:
+        std::unique_ptr<FlyBehavior> m_flyBehavior;
+        std::unique_ptr<QuackBehavior> m_quackBehavior;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        MallardDuck() : Duck(new FlyWithWings, new Quack)
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I'm a mallard duck" << std::endl;
+        }
+};
+
+class RubberDuck : public Duck {
+
+    public:
+        RubberDuck() : Duck(new FlyNoWay, new Squeak)
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a rubber duck" << std::endl;
+        }
+};
+
+} // namespace virtualDispatch
+
+// Static flavor: behaviors are plain value types, the set of them is closed.
+namespace variantDispatch {
+
+class FlyWithWings
+{
+    public:
+        void fly(std::ostream& out) const {
+            if(out) out << "I'm flying!!" << std::endl;
+        }
+};
+
+class FlyNoWay
+{
+    public:
+        void fly(std::ostream& out) const {
+            if(out) out << "I can't fly" << std::endl;
+        }
+};
+
+class FlyRocketPowered
+{
+    public:
+        void fly(std::ostream& out) const {
+            if(out) out << "I'm flying with a rocket!" << std::endl;
+        }
+};
+
+class Quack {
+    public:
+        void quack(std::ostream& out) const {
+            if(out) out << "Quack" << std::endl;
+        }
+};
+
+class MuteQuack {
+    public:
+        void quack(std::ostream& out) const {
+            if(out) out << "Silence" << std::endl;
+        }
+};
+
+class Squeak {
+    public:
+        void quack(std::ostream& out) const {
+            if(out) out << "Squeak" << std::endl;
+        }
+};
+
+using FlyBehavior = std::variant<FlyWithWings, FlyNoWay, FlyRocketPowered>;
+using QuackBehavior = std::variant<Quack, MuteQuack, Squeak>;
+
+class Duck{
+
+    public:
+        Duck(FlyBehavior fb, QuackBehavior qb) : m_flyBehavior(fb), m_quackBehavior(qb)
+        {
+
+        }
+
+        virtual ~Duck() = default;
+
+        virtual void display() = 0;
+
+        void performFly(std::ostream& out = std::cout) const {
+            std::visit([&out](const auto& behavior){ behavior.fly(out); }, m_flyBehavior);
+        };
+
+        void performQuack(std::ostream& out = std::cout) const {
+            std::visit([&out](const auto& behavior){ behavior.quack(out); }, m_quackBehavior);
+        };
+
+        void swim() {
+            std::cout << "All ducks float, even decoys!" << std::endl;
+        }
+
+        void setFlyBehavior(FlyBehavior fb) {
+            m_flyBehavior = fb;
+        }
+
+        void setQuackBehavior(QuackBehavior qb) {
+            m_quackBehavior = qb;
+        }
+
+    private:
+        FlyBehavior m_flyBehavior;
+        QuackBehavior m_quackBehavior;
+
+};
+
+class MallardDuck : public Duck {
+
+    public:
+        MallardDuck() : Duck(FlyWithWings(), Quack())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I'm a mallard duck" << std::endl;
+        }
+};
+
+class RedHeadDuck : public Duck {
+
+    public:
+        RedHeadDuck() : Duck(FlyWithWings(), Quack())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a red head duck" << std::endl;
+        }
+};
+
+class RubberDuck : public Duck {
+
+    public:
+        RubberDuck() : Duck(FlyNoWay(), Squeak())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a rubber duck" << std::endl;
+        }
+};
+
+class DecoyDuck : public Duck {
+
+    public:
+        DecoyDuck() : Duck(FlyNoWay(), MuteQuack())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a decoy duck" << std::endl;
+        }
+};
+
+class ModelDuck : public Duck {
+
+    public:
+        ModelDuck() : Duck(FlyNoWay(), Quack())
+        {
+
+        }
+
+        void display() override {
+            std::cout << "I am a model duck" << std::endl;
+        }
+};
+
+} // namespace variantDispatch
+
+// Runs performFly/performQuack over the flock a number of times and returns
+// the elapsed time in nanoseconds per call.
+template<typename DuckContainer>
+static double benchmark(DuckContainer& ducks, std::size_t rounds, std::ostream& out)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for(std::size_t round = 0; round < rounds; ++round)
+    {
+        for(auto& duck : ducks)
+        {
+            duck->performFly(out);
+            duck->performQuack(out);
+        }
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    double calls = static_cast<double>(rounds * ducks.size() * 2);
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) / calls;
+}
+
+int main(void)
+{
+    std::cout << "chapter 1 - strategy with static dispatch" << std::endl;
+
+    variantDispatch::MallardDuck mallard;
+    variantDispatch::RedHeadDuck redHead;
+    variantDispatch::RubberDuck rubber;
+    variantDispatch::DecoyDuck decoy;
+    variantDispatch::ModelDuck model;
+
+    std::vector<variantDispatch::Duck*> ducks = {&mallard, &redHead, &rubber, &decoy, &model};
+
+    for(auto duck : ducks)
+    {
+        duck->display();
+        duck->performQuack();
+        duck->performFly();
+        std::cout << std::endl;
+    }
+
+    model.setFlyBehavior(variantDispatch::FlyRocketPowered());
+    model.performFly();
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Benchmark: the same flock size and call mix
+    * for both flavors. Output goes to a stream without
+    * a buffer, which is in a failed state, so behaviors
+    * skip formatting and the numbers show the cost of
+    * dispatch and not of the terminal.
+    ********************************************* */
+
+    const std::size_t flockSize = 1000;
+    const std::size_t rounds = 2000;
+    std::ostream discard(nullptr);
+
+    std::vector<std::unique_ptr<virtualDispatch::Duck>> virtualFlock;
+    std::vector<std::unique_ptr<variantDispatch::Duck>> variantFlock;
+
+    for(std::size_t i = 0; i < flockSize; ++i)
+    {
+        if(i % 2 == 0)
+        {
+            virtualFlock.push_back(std::make_unique<virtualDispatch::MallardDuck>());
+            variantFlock.push_back(std::make_unique<variantDispatch::MallardDuck>());
+        }
+        else
+        {
+            virtualFlock.push_back(std::make_unique<virtualDispatch::RubberDuck>());
+            variantFlock.push_back(std::make_unique<variantDispatch::RubberDuck>());
+        }
+    }
+
+    // swap a few behaviors at runtime so both flocks stay mixed
+    for(std::size_t i = 0; i < flockSize; i += 7)
+    {
+        virtualFlock[i]->setFlyBehavior(new virtualDispatch::FlyRocketPowered);
+        variantFlock[i]->setFlyBehavior(variantDispatch::FlyRocketPowered());
+    }
+
+    double virtualNs = benchmark(virtualFlock, rounds, discard);
+    double variantNs = benchmark(variantFlock, rounds, discard);
+
+    std::cout << "calls per flavor: " << flockSize * rounds * 2 << std::endl;
+    std::cout << "virtual dispatch: " << virtualNs << " ns/call" << std::endl;
+    std::cout << "variant dispatch: " << variantNs << " ns/call" << std::endl;
+}
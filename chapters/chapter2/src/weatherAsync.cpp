@@ -0,0 +1,642 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with asynchronous notification. The subject
+* never calls update() itself: every observer has its
+* own bounded queue, setMeasurements only appends to
+* those queues and a pool of worker threads drains
+* them. A slow display therefore cannot stall the
+* producer.
+*
+* At most one worker drains a given queue at a time,
+* so every observer sees its measurements in order.
+* What happens when a queue is full is chosen per
+* observer: block the producer, drop the oldest queued
+* measurement or drop the new one.
+*
+* Dashboard-style observers that only care about the
+* latest state can opt into conflation instead: their
+* queue is a single slot that newer measurements
+* overwrite, so they are woken once and only see the
+* newest values however fast the producer is.
+********************************************* */
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <array>
+#include <deque>
+#include <list>
+#include <string>
+#include <algorithm>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+enum class OverflowPolicy { Block, DropOldest, DropNewest, Conflate };
+
+struct Measurement {
+    float temperature;
+    float humidity;
+    float pressure;
+};
+
+/* *********************************************
+* Queue of one observer. The buffer is protected
+* by its own mutex; `scheduled` is true while the queue
+* sits in the ready list or is being drained, which is
+* what keeps a second worker away from it.
+* `removed` is set once the observer unsubscribed;
+* the producer drops such queues from its list.
+* A conflating queue never holds more than one
+* measurement, whatever capacity was asked for.
+********************************************* */
+
+struct ObserverQueue {
+
+        ObserverQueue(Observer* o, OverflowPolicy overflowPolicy, std::size_t maxQueued)
+            : observer(o), policy(overflowPolicy), capacity(overflowPolicy == OverflowPolicy::Conflate ? 1 : std::max<std::size_t>(1, maxQueued)),
+              mutex(), notFull(), idle(), buffer(), scheduled(false), removed(false), dropped(0), coalesced(0), delivered(0)
+        {
+
+        }
+
+        ObserverQueue(const ObserverQueue&) = delete;
+        ObserverQueue& operator=(const ObserverQueue&) = delete;
+
+        Observer* const observer;
+        const OverflowPolicy policy;
+        const std::size_t capacity;
+
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable idle;
+        std::deque<Measurement> buffer;
+        bool scheduled;
+        // atomic so that a worker can stop in the middle of a batch without taking the mutex
+        std::atomic<bool> removed;
+        std::uint64_t dropped;
+        std::uint64_t coalesced;
+        std::uint64_t delivered;
+};
+
+// The queue whose observer this worker thread is calling right now.
+static thread_local ObserverQueue* deliveringTo = nullptr;
+
+class WeatherData : public Subject {
+    private:
+        std::list<std::shared_ptr<ObserverQueue>> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+        OverflowPolicy m_defaultPolicy;
+        std::size_t m_defaultCapacity;
+
+        std::mutex m_readyMutex;
+        std::condition_variable m_readyChanged;
+        std::deque<std::shared_ptr<ObserverQueue>> m_ready;
+        std::size_t m_busyWorkers;
+        bool m_stop;
+        std::vector<std::thread> m_workers;
+
+        static constexpr std::size_t maxBatch = 32;
+
+    public:
+        WeatherData(std::size_t workers = 2, OverflowPolicy defaultPolicy = OverflowPolicy::DropOldest, std::size_t defaultCapacity = 64)
+            : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0),
+              m_defaultPolicy(defaultPolicy), m_defaultCapacity(defaultCapacity),
+              m_readyMutex(), m_readyChanged(), m_ready(), m_busyWorkers(0), m_stop(false), m_workers()
+        {
+            for(std::size_t i = 0; i < std::max<std::size_t>(1, workers); ++i)
+            {
+                m_workers.emplace_back([this](){ workerLoop(); });
+            }
+        }
+
+        ~WeatherData() override {
+            flush();
+            {
+                const std::lock_guard<std::mutex> lock(m_readyMutex);
+                m_stop = true;
+            }
+            m_readyChanged.notify_all();
+            for(auto& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        WeatherData(const WeatherData&) = delete;
+        WeatherData& operator=(const WeatherData&) = delete;
+
+        // Registration and removal happen on the producer thread, like setMeasurements.
+        void registerObserver(Observer* o) override {
+            registerObserver(o, m_defaultPolicy, m_defaultCapacity);
+        }
+
+        void registerObserver(Observer* o, OverflowPolicy policy, std::size_t capacity) {
+            m_observers.push_back(std::make_shared<ObserverQueue>(o, policy, capacity));
+        }
+
+        // Returns once no worker is inside o->update() any more, pending measurements are discarded.
+        // From inside o->update() it only marks the observer removed: waiting there would wait for itself.
+        void removeObserver(Observer* o) override {
+            if(deliveringTo != nullptr && deliveringTo->observer == o)
+            {
+                ObserverQueue& queue = *deliveringTo;
+                const std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.removed = true;
+                queue.buffer.clear();
+                queue.notFull.notify_all();
+                return;
+            }
+
+            auto found = std::find_if(m_observers.begin(), m_observers.end(),
+                [o](const std::shared_ptr<ObserverQueue>& queue){ return queue->observer == o; });
+            if(found == m_observers.end())
+            {
+                return;
+            }
+
+            std::shared_ptr<ObserverQueue> queue = *found;
+            m_observers.erase(found);
+
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->removed = true;
+            queue->buffer.clear();
+            queue->notFull.notify_all();
+            queue->idle.wait(lock, [&queue](){ return !queue->scheduled; });
+        }
+
+        void notifyObservers() override {
+            const Measurement measurement{m_temperature, m_humidity, m_pressure};
+            for(auto queue = m_observers.begin(); queue != m_observers.end(); )
+            {
+                if(enqueue(*queue, measurement))
+                {
+                    ++queue;
+                }
+                else
+                {
+                    // unsubscribed itself from a worker, see removeObserver
+                    queue = m_observers.erase(queue);
+                }
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+        // Waits until every queued measurement has been delivered.
+        void flush() {
+            std::unique_lock<std::mutex> lock(m_readyMutex);
+            m_readyChanged.wait(lock, [this](){ return m_ready.empty() && m_busyWorkers == 0; });
+        }
+
+        std::uint64_t dropped(Observer* o) const {
+            for(const auto& queue : m_observers)
+            {
+                if(queue->observer == o)
+                {
+                    const std::lock_guard<std::mutex> lock(queue->mutex);
+                    return queue->dropped;
+                }
+            }
+            return 0;
+        }
+
+        // Measurements that a conflating observer never saw because a newer one replaced them.
+        std::uint64_t coalesced(Observer* o) const {
+            for(const auto& queue : m_observers)
+            {
+                if(queue->observer == o)
+                {
+                    const std::lock_guard<std::mutex> lock(queue->mutex);
+                    return queue->coalesced;
+                }
+            }
+            return 0;
+        }
+
+    private:
+        // Returns false when the observer has been removed.
+        bool enqueue(const std::shared_ptr<ObserverQueue>& queue, const Measurement& measurement) {
+            bool schedule = false;
+            {
+                std::unique_lock<std::mutex> lock(queue->mutex);
+                if(queue->removed)
+                {
+                    return false;
+                }
+                if(queue->policy == OverflowPolicy::Conflate && !queue->buffer.empty())
+                {
+                    // the observer is already woken up, it will simply see the newer values
+                    queue->buffer.back() = measurement;
+                    ++queue->coalesced;
+                    return true;
+                }
+                if(queue->buffer.size() >= queue->capacity)
+                {
+                    switch(queue->policy)
+                    {
+                        case OverflowPolicy::Block:
+                            queue->notFull.wait(lock, [&queue](){ return queue->buffer.size() < queue->capacity || queue->removed; });
+                            break;
+                        case OverflowPolicy::DropOldest:
+                            queue->buffer.pop_front();
+                            ++queue->dropped;
+                            break;
+                        case OverflowPolicy::DropNewest:
+                            ++queue->dropped;
+                            return true;
+                        case OverflowPolicy::Conflate:
+                            break; // a full conflating queue was overwritten above
+                    }
+                }
+                if(queue->removed)
+                {
+                    return false;
+                }
+
+                queue->buffer.push_back(measurement);
+                if(!queue->scheduled)
+                {
+                    queue->scheduled = true;
+                    schedule = true;
+                }
+            }
+
+            if(schedule)
+            {
+                {
+                    const std::lock_guard<std::mutex> lock(m_readyMutex);
+                    m_ready.push_back(queue);
+                }
+                m_readyChanged.notify_one();
+            }
+            return true;
+        }
+
+        void workerLoop() {
+            while(true)
+            {
+                std::shared_ptr<ObserverQueue> queue;
+                {
+                    std::unique_lock<std::mutex> lock(m_readyMutex);
+                    m_readyChanged.wait(lock, [this](){ return m_stop || !m_ready.empty(); });
+                    if(m_ready.empty())
+                    {
+                        return;
+                    }
+                    queue = std::move(m_ready.front());
+                    m_ready.pop_front();
+                    ++m_busyWorkers;
+                }
+
+                bool reschedule = drain(*queue);
+
+                {
+                    const std::lock_guard<std::mutex> lock(m_readyMutex);
+                    if(reschedule)
+                    {
+                        // back of the line, so one busy observer cannot starve the others
+                        m_ready.push_back(queue);
+                    }
+                    --m_busyWorkers;
+                }
+                m_readyChanged.notify_all();
+            }
+        }
+
+        // Delivers up to maxBatch measurements. Returns true when more are waiting.
+        bool drain(ObserverQueue& queue) {
+            std::array<Measurement, maxBatch> batch;
+            std::size_t count = 0;
+            {
+                const std::lock_guard<std::mutex> lock(queue.mutex);
+                while(count < maxBatch && !queue.buffer.empty())
+                {
+                    batch[count++] = queue.buffer.front();
+                    queue.buffer.pop_front();
+                }
+            }
+            queue.notFull.notify_all();
+
+            deliveringTo = &queue;
+            std::size_t made = 0;
+            while(made < count && !queue.removed)
+            {
+                queue.observer->update(batch[made].temperature, batch[made].humidity, batch[made].pressure);
+                ++made;
+            }
+            deliveringTo = nullptr;
+
+            const std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.delivered += made;
+            if(queue.buffer.empty() || queue.removed)
+            {
+                queue.scheduled = false;
+                queue.idle.notify_all();
+                return false;
+            }
+            return true;
+        }
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            // one write per line, workers of other observers print concurrently
+            std::ostringstream line;
+            line << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+            std::cout << line.str();
+        }
+
+};
+
+// Shows the first measurement and unsubscribes, from inside update() on a worker thread.
+class FirstReadingDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        std::uint64_t m_updates;
+        Subject* m_weatherData;
+
+    public:
+        FirstReadingDisplay(Subject* weatherData) : m_temperature(0), m_updates(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        FirstReadingDisplay(const FirstReadingDisplay&) = default;
+        FirstReadingDisplay& operator=(const FirstReadingDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            m_temperature = temperature;
+            ++m_updates;
+            m_weatherData->removeObserver(this);
+            display();
+        }
+
+        void display() override {
+            std::ostringstream line;
+            line << "First reading: " << m_temperature << "°C" << std::endl;
+            std::cout << line.str();
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+};
+
+// A display that takes a long time to render every update.
+class SlowDisplay : public Observer, public DisplayElement {
+    private:
+        std::chrono::microseconds m_renderTime;
+        std::atomic<std::uint64_t> m_updates;
+        float m_lastTemperature;
+
+    public:
+        SlowDisplay(std::chrono::microseconds renderTime) : m_renderTime(renderTime), m_updates(0), m_lastTemperature(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            std::this_thread::sleep_for(m_renderTime);
+            m_lastTemperature = temperature;
+            ++m_updates;
+        }
+
+        void display() override {
+            std::ostringstream line;
+            line << "Slow display: " << m_updates << " updates rendered, last " << m_lastTemperature << "°C" << std::endl;
+            std::cout << line.str();
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+};
+
+// Redraws a chart on every update, the work is real CPU time rather than a sleep.
+class DashboardDisplay : public Observer, public DisplayElement {
+    private:
+        std::atomic<std::uint64_t> m_updates;
+        std::atomic<std::int64_t> m_busyNanoseconds;
+        float m_lastTemperature;
+        float m_chart;
+
+    public:
+        DashboardDisplay() : m_updates(0), m_busyNanoseconds(0), m_lastTemperature(0), m_chart(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            auto start = std::chrono::steady_clock::now();
+            float chart = m_chart;
+            for(int i = 0; i < 5000; ++i)
+            {
+                chart = chart * 0.999f + (temperature + humidity * 0.01f + pressure * 0.001f) * 0.001f;
+            }
+            m_chart = chart;
+            m_lastTemperature = temperature;
+            ++m_updates;
+            m_busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void display() override {
+            std::ostringstream line;
+            line << "Dashboard: " << m_updates << " redraws, last " << m_lastTemperature << "°C" << std::endl;
+            std::cout << line.str();
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+
+        double busyMilliseconds() const {
+            return static_cast<double>(m_busyNanoseconds) / 1e6;
+        }
+
+        float lastTemperature() const {
+            return m_lastTemperature;
+        }
+};
+
+static const char* policyName(OverflowPolicy policy)
+{
+    switch(policy)
+    {
+        case OverflowPolicy::Block:
+            return "block";
+        case OverflowPolicy::DropOldest:
+            return "drop-oldest";
+        case OverflowPolicy::DropNewest:
+            return "drop-newest";
+        case OverflowPolicy::Conflate:
+            break;
+    }
+    return "conflate";
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with asynchronous notification" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        FirstReadingDisplay firstReading(&weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+
+        weatherData.flush();
+        std::cout << "first reading display updated " << firstReading.updates() << " time(s)" << std::endl;
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Producer latency with a display that needs 2 ms
+    * per update, fed at a much higher rate. Only the
+    * block policy lets the slow display hold up the
+    * producer.
+    ********************************************* */
+
+    const int measurements = 2000;
+
+    for(OverflowPolicy policy : {OverflowPolicy::DropOldest, OverflowPolicy::DropNewest, OverflowPolicy::Block})
+    {
+        SlowDisplay slowDisplay(std::chrono::microseconds(2000));
+        std::vector<double> latencies;
+        latencies.reserve(measurements);
+        std::uint64_t dropped = 0;
+
+        {
+            WeatherData weatherData(2);
+            weatherData.registerObserver(&slowDisplay, policy, 16);
+
+            for(int i = 0; i < measurements; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                weatherData.setMeasurements(static_cast<float>(i), 50.0f, 1013.0f);
+                auto stop = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+
+                if(policy == OverflowPolicy::Block && i == 100)
+                {
+                    break; // blocking at 2 ms per update, a few are enough to see it
+                }
+            }
+
+            weatherData.flush();
+            dropped = weatherData.dropped(&slowDisplay);
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << policyName(policy) << ": " << latencies.size() << " measurements, producer latency p50 "
+                  << latencies[latencies.size() / 2] << " us, p99 "
+                  << latencies[latencies.size() * 99 / 100] << " us, max "
+                  << latencies.back() << " us; delivered " << slowDisplay.updates()
+                  << ", dropped " << dropped << std::endl;
+    }
+
+    /* *********************************************
+    * A dashboard that only needs the latest values,
+    * fed at a sensor rate of 100 kHz. With a blocking
+    * queue it redraws for every measurement, conflated
+    * it redraws only as often as it can keep up with.
+    ********************************************* */
+
+    const int sensorMeasurements = 50000;
+    const auto sensorPeriod = std::chrono::microseconds(10);
+    std::cout << std::endl;
+
+    for(OverflowPolicy policy : {OverflowPolicy::Block, OverflowPolicy::Conflate})
+    {
+        DashboardDisplay dashboard;
+        std::uint64_t coalesced = 0;
+        double producerMilliseconds = 0.0;
+
+        {
+            WeatherData weatherData(2);
+            weatherData.registerObserver(&dashboard, policy, 64);
+
+            auto start = std::chrono::steady_clock::now();
+            auto next = start;
+            for(int i = 0; i < sensorMeasurements; ++i, next += sensorPeriod)
+            {
+                while(std::chrono::steady_clock::now() < next)
+                {
+                }
+                weatherData.setMeasurements(static_cast<float>(i), 50.0f, 1013.0f);
+            }
+            weatherData.flush();
+            producerMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            coalesced = weatherData.coalesced(&dashboard);
+        }
+
+        std::cout << policyName(policy) << ": " << sensorMeasurements << " measurements in " << producerMilliseconds
+                  << " ms, " << dashboard.updates() << " redraws using " << dashboard.busyMilliseconds()
+                  << " ms of CPU, coalesced " << coalesced << ", last seen " << dashboard.lastTemperature()
+                  << "°C" << std::endl;
+    }
+}
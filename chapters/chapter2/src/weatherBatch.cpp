@@ -0,0 +1,610 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with a batched update. When the subject has
+* several measurements at hand (a replay, a sensor
+* that sends in bursts) it hands them over as one span
+* with updateBatch instead of one update() per
+* measurement. Observers that only implement update()
+* keep working: the default updateBatch calls it for
+* every measurement.
+*
+* The statistics display overrides updateBatch and
+* runs SIMD kernels over the whole block, so one
+* virtual call is spread over hundreds of samples.
+*
+* The program ends with a benchmark: per-measurement
+* updates against batches, for every kernel.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <array>
+#include <vector>
+#include <list>
+#include <memory>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WEATHER_BATCH_X86 1
+#endif
+
+struct Measurement {
+    float temperature;
+    float humidity;
+    float pressure;
+};
+
+// the kernels read a run of measurements as a flat array of floats
+static_assert(sizeof(Measurement) == 3 * sizeof(float), "Measurement must not be padded");
+
+// A view on contiguous elements, std::span is C++20.
+template<typename T>
+class Span {
+    public:
+        Span() : m_data(nullptr), m_size(0)
+        {
+
+        }
+
+        Span(T* data, std::size_t size) : m_data(data), m_size(size)
+        {
+
+        }
+
+        T* data() const {
+            return m_data;
+        }
+
+        std::size_t size() const {
+            return m_size;
+        }
+
+        bool empty() const {
+            return m_size == 0;
+        }
+
+        T& operator[](std::size_t index) const {
+            return m_data[index];
+        }
+
+        T* begin() const {
+            return m_data;
+        }
+
+        T* end() const {
+            return m_data + m_size;
+        }
+
+    private:
+        T* m_data;
+        std::size_t m_size;
+};
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+
+        // Several measurements at once, oldest first.
+        virtual void updateBatch(Span<const Measurement> measurements) {
+            for(const auto& measurement : measurements)
+            {
+                update(measurement.temperature, measurement.humidity, measurement.pressure);
+            }
+        }
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+/* *********************************************
+* setMeasurements with three values notifies at once,
+* as in weather.cpp. addMeasurement collects values and
+* hands them over in batches of batchSize; the span
+* setMeasurements passes a burst straight through.
+* Either way the latest values stay available to
+* observers that pull: addMeasurement stores them
+* right away, before its batch is handed over.
+********************************************* */
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        std::vector<Measurement> m_pending;
+        std::size_t m_batchSize;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        explicit WeatherData(std::size_t batchSize = 256)
+            : m_observers(), m_pending(), m_batchSize(std::max<std::size_t>(1, batchSize)), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+            m_pending.reserve(m_batchSize);
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            flushMeasurements();
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+        void setMeasurements(Span<const Measurement> measurements){
+            flushMeasurements();
+            notifyBatch(measurements);
+        }
+
+        void addMeasurement(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            m_pending.push_back(Measurement{temperature, humidity, pressure});
+            if(m_pending.size() >= m_batchSize)
+            {
+                flushMeasurements();
+            }
+        }
+
+        // Hands what addMeasurement collected to the observers.
+        void flushMeasurements(){
+            if(m_pending.empty())
+            {
+                return;
+            }
+            notifyBatch(Span<const Measurement>(m_pending.data(), m_pending.size()));
+            m_pending.clear();
+        }
+
+    private:
+        void notifyBatch(Span<const Measurement> measurements) {
+            if(measurements.empty())
+            {
+                return;
+            }
+            const Measurement& latest = measurements[measurements.size() - 1];
+            m_temperature = latest.temperature;
+            m_humidity = latest.humidity;
+            m_pressure = latest.pressure;
+            for(auto observer : m_observers)
+            {
+                observer->updateBatch(measurements);
+            }
+        }
+};
+
+/* *********************************************
+* Statistics kernels: sum, minimum and maximum of each
+* field over a run of measurements. Read as floats, a
+* run repeats temperature, humidity, pressure, so with
+* a vector width that is a multiple of 4 floats, three
+* consecutive vectors put each field in fixed lanes: the
+* kernels accumulate lane-wise and sort the lanes out
+* once at the end. Sums are kept in double.
+********************************************* */
+
+struct FieldStatistics {
+    double sum;
+    float min;
+    float max;
+};
+
+using BatchStatistics = std::array<FieldStatistics, 3>;
+
+enum class KernelFlavor { Scalar, SSE, AVX2 };
+
+static BatchStatistics emptyStatistics()
+{
+    const FieldStatistics none{0.0, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+    return BatchStatistics{none, none, none};
+}
+
+static void statisticsScalar(const float* values, std::size_t count, BatchStatistics& statistics)
+{
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        for(std::size_t field = 0; field < 3; ++field)
+        {
+            const float value = values[3 * i + field];
+            statistics[field].sum += value;
+            statistics[field].min = std::min(statistics[field].min, value);
+            statistics[field].max = std::max(statistics[field].max, value);
+        }
+    }
+}
+
+// Folds lane-wise accumulators of `lanes` floats (a multiple of 3 * 4) into the per-field statistics.
+static void foldLanes(const double* sums, const float* mins, const float* maxs, std::size_t lanes, BatchStatistics& statistics)
+{
+    for(std::size_t lane = 0; lane < lanes; ++lane)
+    {
+        FieldStatistics& field = statistics[lane % 3];
+        field.sum += sums[lane];
+        field.min = std::min(field.min, mins[lane]);
+        field.max = std::max(field.max, maxs[lane]);
+    }
+}
+
+#ifdef WEATHER_BATCH_X86
+// 4 measurements = 12 floats = 3 vectors per step.
+static void statisticsSSE(const float* values, std::size_t count, BatchStatistics& statistics)
+{
+    __m128d sums[6];
+    __m128 mins[3];
+    __m128 maxs[3];
+    for(std::size_t v = 0; v < 3; ++v)
+    {
+        sums[2 * v] = _mm_setzero_pd();
+        sums[2 * v + 1] = _mm_setzero_pd();
+        mins[v] = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        maxs[v] = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    }
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const float* block = &values[3 * i];
+        for(std::size_t v = 0; v < 3; ++v)
+        {
+            const __m128 x = _mm_loadu_ps(block + 4 * v);
+            sums[2 * v] = _mm_add_pd(sums[2 * v], _mm_cvtps_pd(x));
+            sums[2 * v + 1] = _mm_add_pd(sums[2 * v + 1], _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            mins[v] = _mm_min_ps(mins[v], x);
+            maxs[v] = _mm_max_ps(maxs[v], x);
+        }
+    }
+
+    alignas(16) double laneSums[12];
+    alignas(16) float laneMins[12];
+    alignas(16) float laneMaxs[12];
+    for(std::size_t v = 0; v < 3; ++v)
+    {
+        _mm_store_pd(&laneSums[4 * v], sums[2 * v]);
+        _mm_store_pd(&laneSums[4 * v + 2], sums[2 * v + 1]);
+        _mm_store_ps(&laneMins[4 * v], mins[v]);
+        _mm_store_ps(&laneMaxs[4 * v], maxs[v]);
+    }
+    foldLanes(laneSums, laneMins, laneMaxs, 12, statistics);
+    statisticsScalar(&values[3 * i], count - i, statistics);
+}
+
+// 8 measurements = 24 floats = 3 vectors per step.
+__attribute__((target("avx2")))
+static void statisticsAVX2(const float* values, std::size_t count, BatchStatistics& statistics)
+{
+    __m256d sums[6];
+    __m256 mins[3];
+    __m256 maxs[3];
+    for(std::size_t v = 0; v < 3; ++v)
+    {
+        sums[2 * v] = _mm256_setzero_pd();
+        sums[2 * v + 1] = _mm256_setzero_pd();
+        mins[v] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        maxs[v] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    }
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const float* block = &values[3 * i];
+        for(std::size_t v = 0; v < 3; ++v)
+        {
+            const __m256 x = _mm256_loadu_ps(block + 8 * v);
+            sums[2 * v] = _mm256_add_pd(sums[2 * v], _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+            sums[2 * v + 1] = _mm256_add_pd(sums[2 * v + 1], _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+            mins[v] = _mm256_min_ps(mins[v], x);
+            maxs[v] = _mm256_max_ps(maxs[v], x);
+        }
+    }
+
+    alignas(32) double laneSums[24];
+    alignas(32) float laneMins[24];
+    alignas(32) float laneMaxs[24];
+    for(std::size_t v = 0; v < 3; ++v)
+    {
+        _mm256_store_pd(&laneSums[8 * v], sums[2 * v]);
+        _mm256_store_pd(&laneSums[8 * v + 4], sums[2 * v + 1]);
+        _mm256_store_ps(&laneMins[8 * v], mins[v]);
+        _mm256_store_ps(&laneMaxs[8 * v], maxs[v]);
+    }
+    foldLanes(laneSums, laneMins, laneMaxs, 24, statistics);
+    statisticsScalar(&values[3 * i], count - i, statistics);
+}
+#endif
+
+static bool isSupported(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::Scalar:
+            return true;
+#ifdef WEATHER_BATCH_X86
+        case KernelFlavor::SSE:
+            return __builtin_cpu_supports("sse2");
+        case KernelFlavor::AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        default:
+            return false;
+#endif
+    }
+    return false;
+}
+
+static KernelFlavor bestFlavor()
+{
+    for(KernelFlavor flavor : {KernelFlavor::AVX2, KernelFlavor::SSE})
+    {
+        if(isSupported(flavor))
+        {
+            return flavor;
+        }
+    }
+    return KernelFlavor::Scalar;
+}
+
+static const char* flavorName(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::SSE:
+            return "SSE";
+        case KernelFlavor::AVX2:
+            return "AVX2";
+        case KernelFlavor::Scalar:
+            break;
+    }
+    return "scalar";
+}
+
+static void batchStatistics(KernelFlavor flavor, Span<const Measurement> measurements, BatchStatistics& statistics)
+{
+    const float* values = &measurements.data()->temperature;
+    switch(flavor)
+    {
+#ifdef WEATHER_BATCH_X86
+        case KernelFlavor::AVX2:
+            // on short runs the setup and the 24-lane fold cost more than the wider vectors save
+            if(measurements.size() >= 64)
+            {
+                statisticsAVX2(values, measurements.size(), statistics);
+                break;
+            }
+            statisticsSSE(values, measurements.size(), statistics);
+            break;
+        case KernelFlavor::SSE:
+            statisticsSSE(values, measurements.size(), statistics);
+            break;
+#endif
+        default:
+            statisticsScalar(values, measurements.size(), statistics);
+            break;
+    }
+}
+
+// Avg/Max/Min of every field since the start, the book's statistics display for all three readings.
+class StatisticsDisplay : public Observer, public DisplayElement {
+    private:
+        BatchStatistics m_statistics;
+        std::uint64_t m_readings;
+        KernelFlavor m_flavor;
+        Subject* m_weatherData;
+
+    public:
+        StatisticsDisplay(Subject* weatherData, KernelFlavor flavor = bestFlavor())
+            : m_statistics(emptyStatistics()), m_readings(0), m_flavor(flavor), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        StatisticsDisplay(const StatisticsDisplay&) = default;
+        StatisticsDisplay& operator=(const StatisticsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            const float values[3] = {temperature, humidity, pressure};
+            for(std::size_t field = 0; field < 3; ++field)
+            {
+                m_statistics[field].sum += values[field];
+                m_statistics[field].min = std::min(m_statistics[field].min, values[field]);
+                m_statistics[field].max = std::max(m_statistics[field].max, values[field]);
+            }
+            ++m_readings;
+        }
+
+        void updateBatch(Span<const Measurement> measurements) override {
+            batchStatistics(m_flavor, measurements, m_statistics);
+            m_readings += measurements.size();
+        }
+
+        void display() override {
+            std::cout << "Avg/Max/Min temperature = " << m_statistics[0].sum / static_cast<double>(m_readings)
+                      << "/" << m_statistics[0].max << "/" << m_statistics[0].min << std::endl;
+        }
+
+        const BatchStatistics& statistics() const {
+            return m_statistics;
+        }
+};
+
+// Only knows update(); batches reach it through the default updateBatch.
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+static bool sameStatistics(const BatchStatistics& left, const BatchStatistics& right)
+{
+    for(std::size_t field = 0; field < 3; ++field)
+    {
+        if(left[field].min != right[field].min || left[field].max != right[field].max
+           || std::abs(left[field].sum - right[field].sum) > 1e-9 * std::abs(right[field].sum))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with batched updates" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        StatisticsDisplay statisticsDisplay(&weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+
+        // a sensor that was offline sends its backlog in one go
+        const Measurement backlog[] = {{22.0f, 50.0f, 29.2f}, {23.5f, 48.0f, 29.1f}, {24.0f, 45.0f, 29.2f}};
+        weatherData.setMeasurements(Span<const Measurement>(backlog, 3));
+        statisticsDisplay.display();
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 64 statistics displays and 4M
+    * measurements of a random walk. First one update()
+    * per measurement, then batches of 16 to 4096 through
+    * addMeasurement, with every kernel. Every run has to
+    * end with the statistics of the first one.
+    ********************************************* */
+
+    const std::size_t displays = 64;
+    const std::size_t measurements = 1u << 22;
+
+    std::mt19937 random(5);
+    std::normal_distribution<float> step(0.0f, 0.05f);
+    std::vector<Measurement> walk(measurements);
+    Measurement current{15.0f, 60.0f, 1013.0f};
+    for(auto& measurement : walk)
+    {
+        current.temperature += step(random);
+        current.humidity += step(random);
+        current.pressure += step(random);
+        measurement = current;
+    }
+
+    BatchStatistics reference = emptyStatistics();
+    double referenceTime = 0.0;
+    bool first = true;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::setw(8) << "batch" << std::setw(10) << "kernel" << std::setw(14) << "ns/sample" << std::setw(10) << "speedup" << std::endl;
+
+    const std::size_t batchSizes[] = {1, 16, 256, 4096};
+    for(std::size_t batchSize : batchSizes)
+    {
+        for(KernelFlavor flavor : {KernelFlavor::Scalar, KernelFlavor::SSE, KernelFlavor::AVX2})
+        {
+            if(!isSupported(flavor) || (batchSize == 1 && flavor != KernelFlavor::Scalar))
+            {
+                continue;
+            }
+
+            WeatherData weatherData(batchSize);
+            std::vector<std::unique_ptr<StatisticsDisplay>> observers;
+            for(std::size_t i = 0; i < displays; ++i)
+            {
+                observers.push_back(std::make_unique<StatisticsDisplay>(&weatherData, flavor));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            if(batchSize == 1)
+            {
+                for(const auto& measurement : walk)
+                {
+                    weatherData.setMeasurements(measurement.temperature, measurement.humidity, measurement.pressure);
+                }
+            }
+            else
+            {
+                for(const auto& measurement : walk)
+                {
+                    weatherData.addMeasurement(measurement.temperature, measurement.humidity, measurement.pressure);
+                }
+                weatherData.flushMeasurements();
+            }
+            auto stop = std::chrono::steady_clock::now();
+
+            const double nanoseconds = std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(measurements * displays);
+            if(first)
+            {
+                reference = observers.front()->statistics();
+                referenceTime = nanoseconds;
+                first = false;
+            }
+
+            std::cout << std::setw(8) << batchSize << std::setw(10) << (batchSize == 1 ? "update()" : flavorName(flavor))
+                      << std::setw(14) << nanoseconds << std::setw(9) << referenceTime / nanoseconds << "x";
+            if(!sameStatistics(observers.back()->statistics(), reference))
+            {
+                std::cout << "  statistics differ";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
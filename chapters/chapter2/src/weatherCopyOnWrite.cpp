@@ -0,0 +1,493 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with a copy-on-write observer registry.
+* The observers live in an immutable array; register
+* and remove copy it, change the copy and publish it
+* with one atomic pointer swap. notifyObservers walks
+* whatever array was current when it started, without
+* taking a lock, so observers may register or remove
+* themselves (or others) from any thread, even from
+* inside update().
+*
+* Old arrays are reclaimed with hazard pointers: a
+* notifying thread announces the array it walks, and
+* a retired array is freed once nobody announces it.
+*
+* The program ends with a benchmark at a 1 MHz update
+* rate while another thread keeps subscribing and
+* unsubscribing displays.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <list>
+#include <memory>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+using ObserverArray = std::vector<Observer*>;
+
+/* *********************************************
+* Hazard pointers for observer arrays. Every thread
+* that notifies gets a record with a few slots, one per
+* nesting level (update() may notify another subject).
+********************************************* */
+
+class HazardPointers {
+
+    public:
+        static constexpr std::size_t maxThreads = 128;
+        static constexpr std::size_t slotsPerThread = 4;
+
+        static HazardPointers& instance() {
+            static HazardPointers hazards;
+            return hazards;
+        }
+
+        HazardPointers(const HazardPointers&) = delete;
+        HazardPointers& operator=(const HazardPointers&) = delete;
+
+        // Publishes the current value of source in a free slot of this thread and returns it.
+        const ObserverArray* protect(const std::atomic<const ObserverArray*>& source, std::size_t& slot) {
+            Record& record = threadRecord();
+            if(record.depth == slotsPerThread)
+            {
+                throw std::runtime_error("notifications nested too deeply");
+            }
+            slot = record.depth++;
+
+            const ObserverArray* array = source.load();
+            while(true)
+            {
+                record.slots[slot].store(array);
+                // the array may have been retired before it was announced, check again
+                const ObserverArray* current = source.load();
+                if(current == array)
+                {
+                    return array;
+                }
+                array = current;
+            }
+        }
+
+        void release(std::size_t slot) {
+            Record& record = threadRecord();
+            record.slots[slot].store(nullptr, std::memory_order_release);
+            --record.depth;
+        }
+
+        bool isProtected(const ObserverArray* array) const {
+            for(const auto& record : m_records)
+            {
+                for(const auto& slot : record.slots)
+                {
+                    if(slot.load() == array)
+                    {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        struct alignas(64) Record {
+            std::atomic<bool> used;
+            std::size_t depth;
+            std::array<std::atomic<const ObserverArray*>, slotsPerThread> slots;
+        };
+
+        HazardPointers() : m_records()
+        {
+            for(auto& record : m_records)
+            {
+                record.used.store(false);
+                record.depth = 0;
+                for(auto& slot : record.slots)
+                {
+                    slot.store(nullptr);
+                }
+            }
+        }
+
+        // The record is handed back when the thread ends.
+        Record& threadRecord() {
+            struct Owner {
+                Record* record;
+                ~Owner() {
+                    if(record != nullptr)
+                    {
+                        record->used.store(false);
+                    }
+                }
+            };
+            thread_local Owner owner{nullptr};
+
+            if(owner.record == nullptr)
+            {
+                for(auto& record : m_records)
+                {
+                    bool expected = false;
+                    if(record.used.compare_exchange_strong(expected, true))
+                    {
+                        owner.record = &record;
+                        break;
+                    }
+                }
+                if(owner.record == nullptr)
+                {
+                    throw std::runtime_error("too many notifying threads");
+                }
+            }
+            return *owner.record;
+        }
+
+        std::array<Record, maxThreads> m_records;
+};
+
+class WeatherData : public Subject {
+    private:
+        std::atomic<const ObserverArray*> m_observers;
+        std::mutex m_writerMutex;
+        std::vector<const ObserverArray*> m_retired;
+        std::atomic<float> m_temperature;
+        std::atomic<float> m_humidity;
+        std::atomic<float> m_pressure;
+
+    public:
+        WeatherData() : m_observers(new ObserverArray()), m_writerMutex(), m_retired(),
+            m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        ~WeatherData() override {
+            // no notification may be running any more
+            delete m_observers.load();
+            for(auto array : m_retired)
+            {
+                delete array;
+            }
+        }
+
+        WeatherData(const WeatherData&) = delete;
+        WeatherData& operator=(const WeatherData&) = delete;
+
+        // Thread safe. Costs one copy of the observer array.
+        void registerObserver(Observer* o) override {
+            const std::lock_guard<std::mutex> lock(m_writerMutex);
+            auto copy = std::make_unique<ObserverArray>(*m_observers.load());
+            copy->push_back(o);
+            publish(copy.release());
+        }
+
+        // Thread safe. A notification already running may still call o once.
+        void removeObserver(Observer* o) override {
+            const std::lock_guard<std::mutex> lock(m_writerMutex);
+            const ObserverArray* current = m_observers.load();
+            if(std::find(current->begin(), current->end(), o) == current->end())
+            {
+                return;
+            }
+            auto copy = std::make_unique<ObserverArray>();
+            copy->reserve(current->size() - 1);
+            std::copy_if(current->begin(), current->end(), std::back_inserter(*copy),
+                [o](Observer* observer){ return observer != o; });
+            publish(copy.release());
+        }
+
+        // Lock-free: walks the array that was current when it started.
+        void notifyObservers() override {
+            HazardPointers& hazards = HazardPointers::instance();
+            std::size_t slot = 0;
+            const ObserverArray* observers = hazards.protect(m_observers, slot);
+
+            const float temperature = m_temperature.load(std::memory_order_relaxed);
+            const float humidity = m_humidity.load(std::memory_order_relaxed);
+            const float pressure = m_pressure.load(std::memory_order_relaxed);
+            for(Observer* observer : *observers)
+            {
+                observer->update(temperature, humidity, pressure);
+            }
+
+            hazards.release(slot);
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature.store(temperature, std::memory_order_relaxed);
+            m_humidity.store(humidity, std::memory_order_relaxed);
+            m_pressure.store(pressure, std::memory_order_relaxed);
+            measurementsChanged();
+        }
+
+        std::size_t observerCount() const {
+            return m_observers.load()->size();
+        }
+
+    private:
+        // Called with m_writerMutex held.
+        void publish(const ObserverArray* next) {
+            m_retired.push_back(m_observers.exchange(next));
+
+            HazardPointers& hazards = HazardPointers::instance();
+            auto stillUsed = std::partition(m_retired.begin(), m_retired.end(),
+                [&hazards](const ObserverArray* array){ return hazards.isProtected(array); });
+            for(auto it = stillUsed; it != m_retired.end(); ++it)
+            {
+                delete *it;
+            }
+            m_retired.erase(stillUsed, m_retired.end());
+        }
+};
+
+// Baseline for the benchmark: the original std::list, guarded by one mutex.
+class LockedWeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        std::mutex m_mutex;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        LockedWeatherData() : m_observers(), m_mutex(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            notifyObservers();
+        }
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// Shows the latest reading once, then unsubscribes itself from inside update().
+class OneShotDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        Subject* m_weatherData;
+
+    public:
+        OneShotDisplay(Subject* weatherData) : m_temperature(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        OneShotDisplay(const OneShotDisplay&) = default;
+        OneShotDisplay& operator=(const OneShotDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            m_temperature = temperature;
+            display();
+            m_weatherData->removeObserver(this);
+        }
+
+        void display() override {
+            std::cout << "One-shot display: " << m_temperature << "°C, unsubscribing" << std::endl;
+        }
+};
+
+class CountingDisplay : public Observer {
+    public:
+        CountingDisplay() : m_sum(0.0f)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_sum += temperature + humidity + pressure;
+        }
+
+    private:
+        float m_sum;
+};
+
+struct ChurnResult {
+    double p50;
+    double p99;
+    double max;
+    std::size_t updates;
+    std::size_t churnOperations;
+};
+
+// Updates at 1 MHz for `duration` while a second thread subscribes and unsubscribes displays.
+template<typename Weather>
+static ChurnResult runChurn(Weather& weatherData, std::chrono::milliseconds duration)
+{
+    std::vector<CountingDisplay> residents(100);
+    for(auto& display : residents)
+    {
+        weatherData.registerObserver(&display);
+    }
+
+    std::atomic<bool> running(true);
+    std::size_t churnOperations = 0;
+    std::thread churn([&](){
+        std::vector<CountingDisplay> visitors(16);
+        while(running.load(std::memory_order_relaxed))
+        {
+            for(auto& display : visitors)
+            {
+                weatherData.registerObserver(&display);
+            }
+            for(auto& display : visitors)
+            {
+                weatherData.removeObserver(&display);
+            }
+            churnOperations += visitors.size() * 2;
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<double> latencies;
+    latencies.reserve(static_cast<std::size_t>(duration.count()) * 1000);
+    const auto period = std::chrono::microseconds(1);
+    auto start = std::chrono::steady_clock::now();
+    auto next = start;
+
+    while(next - start < duration)
+    {
+        while(std::chrono::steady_clock::now() < next)
+        {
+        }
+        auto before = std::chrono::steady_clock::now();
+        weatherData.setMeasurements(20.0f, 50.0f, 1013.0f);
+        auto after = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(after - before).count());
+        next += period;
+        if(after > next)
+        {
+            next = after; // fell behind, don't try to catch up with a burst
+        }
+    }
+
+    running = false;
+    churn.join();
+    for(auto& display : residents)
+    {
+        weatherData.removeObserver(&display);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    return ChurnResult{latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+        latencies.back(), latencies.size(), churnOperations};
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with a copy-on-write registry" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        OneShotDisplay oneShotDisplay(&weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        std::cout << "observers left: " << weatherData.observerCount() << std::endl << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 100 resident displays notified at a
+    * target rate of 1 MHz, 16 displays subscribing and
+    * unsubscribing in a loop on another thread.
+    ********************************************* */
+
+    const std::chrono::milliseconds duration(300);
+
+    WeatherData copyOnWrite;
+    ChurnResult cow = runChurn(copyOnWrite, duration);
+
+    LockedWeatherData locked;
+    ChurnResult mutex = runChurn(locked, duration);
+
+    for(const auto& result : {std::make_pair("copy-on-write", cow), std::make_pair("mutex + list ", mutex)})
+    {
+        std::cout << result.first << ": " << result.second.updates << " updates, notify latency p50 "
+                  << result.second.p50 << " us, p99 " << result.second.p99 << " us, max " << result.second.max
+                  << " us; " << result.second.churnOperations << " subscribe/unsubscribe calls" << std::endl;
+    }
+}
@@ -0,0 +1,508 @@
+/* *********************************************
+* Benchmark of the OBSERVER fan-out: what one
+* notifyObservers costs with 1 to 1M registered
+* observers, to know how many displays one subject
+* can carry before it has to be sharded.
+*
+* Three ways to hold the observers:
+* - list:    the std::list<Observer*> of weather.cpp
+* - vector:  the same pointers in a std::vector
+* - batch:   pointers to displays of one concrete
+*            (final) type, called without virtual
+*            dispatch
+*
+* and three observer bodies: empty, some arithmetic,
+* and one that allocates on every update. All three
+* subjects notify the same display objects, so they
+* differ only in how they reach them.
+*
+* Reported per configuration: ns per update() call,
+* cache misses per call (from perf_event_open, when
+* the kernel lets us), the p50/p99/max latency of a
+* whole notifyObservers (p99 only from 100 timed
+* notifications on), and a checksum read from the
+* displays after the run: no body can be optimised
+* away, and as every run starts from reset displays,
+* the three subjects must agree on it.
+*
+* Usage: chapter2_11 [max observers]
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <cmath>
+#include <random>
+#include <memory>
+#include <vector>
+#include <list>
+#include <string>
+#include <algorithm>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+/* *********************************************
+* Observer bodies. They are final so that the batch
+* subject can call them directly.
+********************************************* */
+
+// Does nothing, but is still called: it is never inlined and the barrier keeps the call from being dropped.
+class EmptyDisplay final : public Observer {
+    public:
+        __attribute__((noinline)) void update(float temp, float humidity, float pressure) override {
+            (void)temp;
+            (void)humidity;
+            (void)pressure;
+            asm volatile("" ::: "memory");
+        }
+
+        void reset() {
+        }
+};
+
+// Smoothed values and a dew point, about what a small display computes.
+class ArithmeticDisplay final : public Observer {
+    public:
+        ArithmeticDisplay() : m_temperature(0.0f), m_humidity(0.0f), m_pressure(0.0f), m_dewPoint(0.0f)
+        {
+
+        }
+
+        void update(float temp, float humidity, float pressure) override {
+            m_temperature += 0.1f * (temp - m_temperature);
+            m_humidity += 0.1f * (humidity - m_humidity);
+            m_pressure += 0.1f * (pressure - m_pressure);
+            const float gamma = std::log(std::max(m_humidity, 1.0f) / 100.0f) + 17.62f * m_temperature / (243.12f + m_temperature);
+            m_dewPoint = 243.12f * gamma / (17.62f - gamma);
+        }
+
+        float dewPoint() const {
+            return m_dewPoint;
+        }
+
+        void reset() {
+            m_temperature = 0.0f;
+            m_humidity = 0.0f;
+            m_pressure = 0.0f;
+            m_dewPoint = 0.0f;
+        }
+
+    private:
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+        float m_dewPoint;
+};
+
+// Formats a line of text on every update, like a display that renders strings.
+class AllocatingDisplay final : public Observer {
+    public:
+        AllocatingDisplay() : m_line()
+        {
+
+        }
+
+        void update(float temp, float humidity, float pressure) override {
+            std::string line = "Current conditions: " + std::to_string(temp) + "°C and " + std::to_string(humidity)
+                + "% humidity at " + std::to_string(pressure) + " inHg";
+            m_line.swap(line);
+        }
+
+        const std::string& line() const {
+            return m_line;
+        }
+
+        void reset() {
+            m_line.clear();
+        }
+
+    private:
+        std::string m_line;
+};
+
+// What the checksum reads from each kind of display after a run.
+static double checksumOf(const EmptyDisplay&)
+{
+    return 0.0;
+}
+
+static double checksumOf(const ArithmeticDisplay& display)
+{
+    return display.dewPoint();
+}
+
+static double checksumOf(const AllocatingDisplay& display)
+{
+    return static_cast<double>(display.line().size());
+}
+
+/* *********************************************
+* The three subjects.
+********************************************* */
+
+class ListWeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        ListWeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            notifyObservers();
+        }
+};
+
+class VectorWeatherData : public Subject {
+    private:
+        std::vector<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        VectorWeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), o), m_observers.end());
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            notifyObservers();
+        }
+};
+
+// Holds displays of one type and calls them without going through the vtable.
+template<typename Display>
+class BatchWeatherData {
+    private:
+        std::vector<Display*> m_displays;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        BatchWeatherData() : m_displays(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Display* display) {
+            m_displays.push_back(display);
+        }
+
+        void notifyObservers() {
+            for(auto display : m_displays)
+            {
+                display->Display::update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            notifyObservers();
+        }
+};
+
+/* *********************************************
+* Hardware cache misses of this thread through
+* perf_event_open. Containers and restricted kernels
+* often refuse it; then available() is false.
+********************************************* */
+
+class CacheMissCounter {
+
+    public:
+        CacheMissCounter() : m_fd(-1)
+        {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        }
+
+        ~CacheMissCounter() {
+            if(m_fd >= 0)
+            {
+                ::close(m_fd);
+            }
+        }
+
+        CacheMissCounter(const CacheMissCounter&) = delete;
+        CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+        bool available() const {
+            return m_fd >= 0;
+        }
+
+        void start() {
+            if(m_fd >= 0)
+            {
+                ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        std::uint64_t stop() {
+            std::uint64_t count = 0;
+            if(m_fd >= 0)
+            {
+                ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+                if(::read(m_fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+                {
+                    count = 0;
+                }
+            }
+            return count;
+        }
+
+    private:
+        int m_fd;
+};
+
+struct Result {
+    double nanosecondsPerCall;
+    double missesPerCall;
+    double p50;
+    double p99;
+    double max;
+    std::size_t timed;
+};
+
+// Below this many timed notifications the p99 would only be the maximum again.
+static constexpr std::size_t minimumForP99 = 100;
+
+// Runs `notify` until about `calls` update() calls were made: untimed ones for the throughput, then timed ones for the latency.
+template<typename Notify>
+static Result measure(std::size_t observers, std::size_t calls, CacheMissCounter& misses, Notify notify)
+{
+    const std::size_t repetitions = std::max<std::size_t>(3, calls / observers);
+    notify(0); // warm up
+
+    misses.start();
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < repetitions; ++i)
+    {
+        notify(i);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    const std::uint64_t missCount = misses.stop();
+
+    std::vector<double> latencies(std::min<std::size_t>(repetitions, 1000));
+    for(std::size_t i = 0; i < latencies.size(); ++i)
+    {
+        auto before = std::chrono::steady_clock::now();
+        notify(i);
+        latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count();
+    }
+
+    const double made = static_cast<double>(repetitions * observers);
+    std::sort(latencies.begin(), latencies.end());
+    return Result{std::chrono::duration<double, std::nano>(stop - start).count() / made,
+                  static_cast<double>(missCount) / made,
+                  latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back(), latencies.size()};
+}
+
+static float temperatureAt(std::size_t i)
+{
+    return 20.0f + static_cast<float>(i % 10);
+}
+
+// One body, one observer count, all three subjects.
+template<typename Display>
+static void runBody(const char* body, std::size_t observers, std::size_t calls, CacheMissCounter& misses)
+{
+    // displays allocated one by one and registered in shuffled order, like in a process where they come and go
+    std::vector<std::unique_ptr<Display>> displays;
+    displays.reserve(observers);
+    for(std::size_t i = 0; i < observers; ++i)
+    {
+        displays.push_back(std::make_unique<Display>());
+    }
+    std::shuffle(displays.begin(), displays.end(), std::mt19937(1));
+
+    ListWeatherData list;
+    VectorWeatherData vector;
+    BatchWeatherData<Display> batch;
+    for(auto& display : displays)
+    {
+        list.registerObserver(display.get());
+        vector.registerObserver(display.get());
+        batch.registerObserver(display.get());
+    }
+
+    // Every run starts from fresh displays and sends the same measurements, so the three checksums
+    // must match; reading them back also means that the updates have to happen.
+    auto reset = [&displays](){
+        for(auto& display : displays)
+        {
+            display->reset();
+        }
+    };
+    auto checksum = [&displays](){
+        double sum = 0.0;
+        for(const auto& display : displays)
+        {
+            sum += checksumOf(*display);
+        }
+        return sum;
+    };
+
+    Result results[3];
+    double checksums[3];
+    reset();
+    results[0] = measure(observers, calls, misses, [&list](std::size_t i){ list.setMeasurements(temperatureAt(i), 50.0f, 29.2f); });
+    checksums[0] = checksum();
+    reset();
+    results[1] = measure(observers, calls, misses, [&vector](std::size_t i){ vector.setMeasurements(temperatureAt(i), 50.0f, 29.2f); });
+    checksums[1] = checksum();
+    reset();
+    results[2] = measure(observers, calls, misses, [&batch](std::size_t i){ batch.setMeasurements(temperatureAt(i), 50.0f, 29.2f); });
+    checksums[2] = checksum();
+    const char* containers[3] = {"list", "vector", "batch"};
+
+    for(std::size_t c = 0; c < 3; ++c)
+    {
+        std::cout << std::setw(9) << observers << std::setw(12) << body << std::setw(8) << containers[c]
+                  << std::setw(12) << results[c].nanosecondsPerCall;
+        if(misses.available())
+        {
+            std::cout << std::setw(14) << results[c].missesPerCall;
+        }
+        else
+        {
+            std::cout << std::setw(14) << "n/a";
+        }
+        std::cout << std::setw(12) << results[c].p50;
+        if(results[c].timed >= minimumForP99)
+        {
+            std::cout << std::setw(12) << results[c].p99;
+        }
+        else
+        {
+            std::cout << std::setw(12) << "n/a";
+        }
+        std::cout << std::setw(12) << results[c].max << std::setw(14) << checksums[c]
+                  << (checksums[c] == checksums[0] ? "" : "  CHECKSUM DIFFERS") << std::endl;
+    }
+}
+
+// more observers than this does not fit in memory with the allocating body
+static constexpr std::size_t maxObserversLimit = 10000000;
+
+// A decimal count in [1, limit], digits only: strtoul alone would take blanks and a sign.
+static bool parseCount(const char* text, std::size_t limit, std::size_t& value)
+{
+    if(!std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long parsed = std::strtoul(text, &end, 10);
+    if(*end != '\0' || errno != 0 || parsed == 0 || parsed > limit)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "chapter 2 - observer fan-out benchmark" << std::endl;
+
+    std::size_t maxObservers = 1000000;
+    if(argc > 2 || (argc == 2 && !parseCount(argv[1], maxObserversLimit, maxObservers)))
+    {
+        std::cerr << "usage: " << argv[0] << " [max observers]" << std::endl;
+        return 1;
+    }
+
+    CacheMissCounter misses;
+    if(!misses.available())
+    {
+        std::cout << "perf_event_open refused (" << std::strerror(errno) << "), cache misses not measured" << std::endl;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::setw(9) << "observers" << std::setw(12) << "body" << std::setw(8) << "subject"
+              << std::setw(12) << "ns/call" << std::setw(14) << "misses/call"
+              << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "max us" << std::setw(14) << "checksum" << std::endl;
+
+    for(std::size_t observers = 1; observers <= maxObservers; observers *= 10)
+    {
+        runBody<EmptyDisplay>("empty", observers, 4000000, misses);
+        runBody<ArithmeticDisplay>("arithmetic", observers, 4000000, misses);
+        runBody<AllocatingDisplay>("allocating", observers, 200000, misses);
+    }
+}
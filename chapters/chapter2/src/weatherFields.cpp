@@ -0,0 +1,379 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with field-level subscriptions. An
+* observer says which of temperature, humidity and
+* pressure it cares about and, per field, how far a
+* value has to move from what it last saw before it
+* wants to hear about it (a deadband).
+*
+* The subject does the filtering before dispatch, so
+* observers with nothing to do are never called. The
+* subscriptions are kept in flat arrays next to the
+* observer pointers, which keeps the filter loop tight
+* with thousands of observers. Suppressed notifications
+* are counted per observer.
+*
+* The filter runs as a separate pass that only
+* compares floats, one array per field, so the compiler
+* can vectorize it; the dispatch pass then calls the
+* observers whose flag is set.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+enum Field : unsigned {
+    Temperature = 1u << 0,
+    Humidity = 1u << 1,
+    Pressure = 1u << 2,
+    AllFields = Temperature | Humidity | Pressure
+};
+
+/* *********************************************
+* What one observer wants to hear about. A deadband
+* of 0 passes every update of the field, even one that
+* did not change it, which is what plain registration
+* does.
+********************************************* */
+
+struct Subscription {
+    unsigned fields;
+    std::array<float, 3> deadbands;
+
+    static Subscription to(unsigned fields) {
+        return Subscription{fields, {0.0f, 0.0f, 0.0f}};
+    }
+
+    Subscription& deadband(Field field, float minimumChange) {
+        for(std::size_t i = 0; i < deadbands.size(); ++i)
+        {
+            if(field & (1u << i))
+            {
+                deadbands[i] = minimumChange;
+            }
+        }
+        return *this;
+    }
+};
+
+class WeatherData : public Subject {
+    private:
+        // one entry per observer in each array; a field that is not subscribed has a NaN deadband,
+        // which fails every comparison
+        std::vector<Observer*> m_observers;
+        std::array<std::vector<float>, 3> m_deadbands;
+        std::array<std::vector<float>, 3> m_lastDelivered;
+        std::vector<std::uint8_t> m_wanted;
+        std::vector<std::uint64_t> m_delivered;
+        std::vector<std::uint64_t> m_registeredAt;
+        // suppressed = notifications since registration - delivered, so the hot loop never counts them
+        std::uint64_t m_notifications;
+
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_deadbands(), m_lastDelivered(), m_wanted(), m_delivered(), m_registeredAt(), m_notifications(0),
+            m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            registerObserver(o, Subscription::to(AllFields));
+        }
+
+        void registerObserver(Observer* o, const Subscription& subscription) {
+            // infinitely far away, so the first update of a subscribed field always passes
+            const float never = std::numeric_limits<float>::infinity();
+            m_observers.push_back(o);
+            for(std::size_t field = 0; field < m_deadbands.size(); ++field)
+            {
+                const bool subscribed = subscription.fields & (1u << field);
+                m_deadbands[field].push_back(subscribed ? subscription.deadbands[field] : std::numeric_limits<float>::quiet_NaN());
+                m_lastDelivered[field].push_back(never);
+            }
+            m_wanted.push_back(0);
+            m_delivered.push_back(0);
+            m_registeredAt.push_back(m_notifications);
+        }
+
+        void removeObserver(Observer* o) override {
+            auto found = std::find(m_observers.begin(), m_observers.end(), o);
+            if(found == m_observers.end())
+            {
+                return;
+            }
+            const auto index = found - m_observers.begin();
+            m_observers.erase(found);
+            for(std::size_t field = 0; field < m_deadbands.size(); ++field)
+            {
+                m_deadbands[field].erase(m_deadbands[field].begin() + index);
+                m_lastDelivered[field].erase(m_lastDelivered[field].begin() + index);
+            }
+            m_wanted.erase(m_wanted.begin() + index);
+            m_delivered.erase(m_delivered.begin() + index);
+            m_registeredAt.erase(m_registeredAt.begin() + index);
+        }
+
+        void notifyObservers() override {
+            const std::array<float, 3> values{m_temperature, m_humidity, m_pressure};
+            filter(values);
+            ++m_notifications;
+
+            for(std::size_t i = 0; i < m_observers.size(); ++i)
+            {
+                if(!m_wanted[i])
+                {
+                    continue;
+                }
+                for(std::size_t field = 0; field < values.size(); ++field)
+                {
+                    m_lastDelivered[field][i] = values[field];
+                }
+                ++m_delivered[i];
+                m_observers[i]->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+        std::uint64_t delivered(Observer* o) const {
+            auto found = std::find(m_observers.begin(), m_observers.end(), o);
+            return found == m_observers.end() ? 0 : m_delivered[static_cast<std::size_t>(found - m_observers.begin())];
+        }
+
+        std::uint64_t suppressed(Observer* o) const {
+            auto found = std::find(m_observers.begin(), m_observers.end(), o);
+            if(found == m_observers.end())
+            {
+                return 0;
+            }
+            const auto index = static_cast<std::size_t>(found - m_observers.begin());
+            return m_notifications - m_registeredAt[index] - m_delivered[index];
+        }
+
+        std::uint64_t totalDelivered() const {
+            std::uint64_t total = 0;
+            for(auto count : m_delivered)
+            {
+                total += count;
+            }
+            return total;
+        }
+
+        std::uint64_t totalSuppressed() const {
+            std::uint64_t total = 0;
+            for(std::size_t i = 0; i < m_observers.size(); ++i)
+            {
+                total += m_notifications - m_registeredAt[i] - m_delivered[i];
+            }
+            return total;
+        }
+
+    private:
+        // Sets m_wanted[i] for every observer that a subscribed field moved far enough for.
+        void filter(const std::array<float, 3>& values) {
+            const std::size_t count = m_observers.size();
+            const float* lastTemperature = m_lastDelivered[0].data();
+            const float* lastHumidity = m_lastDelivered[1].data();
+            const float* lastPressure = m_lastDelivered[2].data();
+            const float* temperatureBand = m_deadbands[0].data();
+            const float* humidityBand = m_deadbands[1].data();
+            const float* pressureBand = m_deadbands[2].data();
+            std::uint8_t* wanted = m_wanted.data();
+
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                wanted[i] = static_cast<std::uint8_t>((std::abs(values[0] - lastTemperature[i]) >= temperatureBand[i])
+                    | (std::abs(values[1] - lastHumidity[i]) >= humidityBand[i])
+                    | (std::abs(values[2] - lastPressure[i]) >= pressureBand[i]));
+            }
+        }
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        WeatherData* m_weatherData;
+
+    public:
+        // pressure is not shown, and changes below half a degree or one percent are not worth a redraw
+        CurrentConditionsDisplay(WeatherData* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this, Subscription::to(Temperature | Humidity).deadband(Temperature, 0.5f).deadband(Humidity, 1.0f));
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// A narrow consumer: one field, and it only reacts to moves larger than its threshold.
+class ThresholdAlarm : public Observer {
+    public:
+        ThresholdAlarm(std::size_t field, float threshold) : m_field(field), m_threshold(threshold), m_last(0.0f), m_calls(0), m_alarms(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            ++m_calls;
+            const float values[3] = {temperature, humidity, pressure};
+            // what every observer had to do for itself before the subject filtered
+            if(std::abs(values[m_field] - m_last) >= m_threshold)
+            {
+                m_last = values[m_field];
+                ++m_alarms;
+            }
+        }
+
+        std::uint64_t calls() const {
+            return m_calls;
+        }
+
+        std::uint64_t alarms() const {
+            return m_alarms;
+        }
+
+    private:
+        std::size_t m_field;
+        float m_threshold;
+        float m_last;
+        std::uint64_t m_calls;
+        std::uint64_t m_alarms;
+};
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with field subscriptions and deadbands" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(12.2, 65.5, 29.4); // too small a change to redraw
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 30.1); // only pressure moved
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+
+        std::cout << "delivered " << weatherData.delivered(&currentDisplay) << ", suppressed "
+                  << weatherData.suppressed(&currentDisplay) << std::endl << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 5000 alarms, each on one field with a
+    * threshold between 0.1 and 2, fed with a random walk.
+    * Registered plainly every alarm is called for every
+    * update; subscribed, the subject filters first.
+    ********************************************* */
+
+    const std::size_t alarms = 5000;
+    const int updates = 20000;
+
+    std::mt19937 random(11);
+    std::normal_distribution<float> step(0.0f, 0.05f);
+    std::vector<std::array<float, 3>> walk(updates);
+    std::array<float, 3> current{20.0f, 50.0f, 1013.0f};
+    for(auto& values : walk)
+    {
+        for(auto& value : current)
+        {
+            value += step(random);
+        }
+        values = current;
+    }
+
+    for(bool subscribed : {false, true})
+    {
+        std::vector<ThresholdAlarm> observers;
+        observers.reserve(alarms);
+        WeatherData weatherData;
+        for(std::size_t i = 0; i < alarms; ++i)
+        {
+            const std::size_t field = i % 3;
+            const float threshold = 0.1f + static_cast<float>(i % 20) * 0.1f;
+            observers.emplace_back(field, subscribed ? 0.0f : threshold);
+            if(subscribed)
+            {
+                const Field only = static_cast<Field>(1u << field);
+                weatherData.registerObserver(&observers.back(), Subscription::to(only).deadband(only, threshold));
+            }
+            else
+            {
+                weatherData.registerObserver(&observers.back());
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for(const auto& values : walk)
+        {
+            weatherData.setMeasurements(values[0], values[1], values[2]);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        std::uint64_t calls = 0;
+        std::uint64_t fired = 0;
+        for(const auto& observer : observers)
+        {
+            calls += observer.calls();
+            fired += observer.alarms();
+        }
+
+        std::cout << (subscribed ? "subscribed: " : "all fields: ")
+                  << std::chrono::duration<double, std::micro>(stop - start).count() / updates << " us per update, "
+                  << calls << " update() calls, " << fired << " alarms, " << weatherData.totalSuppressed()
+                  << " notifications suppressed" << std::endl;
+    }
+}
@@ -0,0 +1,521 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with the forecast display from the book.
+* Instead of comparing the last two pressures, the
+* display fits a least-squares line through a window
+* of recent pressures and temperatures and forecasts
+* from its slope.
+*
+* Every series lives in a ring buffer. Adding a sample
+* updates the regression sums in O(1): when the oldest
+* sample leaves, every remaining sample moves one step
+* left on the x axis, which only changes sum(x*y) by
+* sum(y). Resizing the window refits from scratch with
+* a SIMD kernel over the buffer.
+*
+* The program ends with a benchmark of thousands of
+* stations, incremental against full refit per update.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <list>
+#include <string>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WEATHER_FORECAST_X86 1
+#endif
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+};
+
+/* *********************************************
+* Refit kernels: sum(y) and sum(x*y) over a run of
+* samples whose x coordinates start at firstX. The
+* samples are floats, the sums are kept in double like
+* the incremental ones.
+********************************************* */
+
+struct TrendSums {
+    double y;
+    double xy;
+};
+
+enum class KernelFlavor { Scalar, SSE, AVX2 };
+
+static TrendSums sumsScalar(const float* y, std::size_t count, double firstX)
+{
+    TrendSums sums{0.0, 0.0};
+    double x = firstX;
+    for(std::size_t i = 0; i < count; ++i, x += 1.0)
+    {
+        sums.y += y[i];
+        sums.xy += x * y[i];
+    }
+    return sums;
+}
+
+#ifdef WEATHER_FORECAST_X86
+static double horizontalSum(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static TrendSums sumsSSE(const float* y, std::size_t count, double firstX)
+{
+    __m128d sumY = _mm_setzero_pd();
+    __m128d sumXY = _mm_setzero_pd();
+    __m128d xLow = _mm_set_pd(firstX + 1.0, firstX);
+    __m128d xHigh = _mm_set_pd(firstX + 3.0, firstX + 2.0);
+    const __m128d step = _mm_set1_pd(4.0);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps(&y[i]);
+        const __m128d low = _mm_cvtps_pd(v);
+        const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+
+        sumY = _mm_add_pd(sumY, _mm_add_pd(low, high));
+        sumXY = _mm_add_pd(sumXY, _mm_add_pd(_mm_mul_pd(xLow, low), _mm_mul_pd(xHigh, high)));
+        xLow = _mm_add_pd(xLow, step);
+        xHigh = _mm_add_pd(xHigh, step);
+    }
+
+    TrendSums tail = sumsScalar(&y[i], count - i, firstX + static_cast<double>(i));
+    return TrendSums{horizontalSum(sumY) + tail.y, horizontalSum(sumXY) + tail.xy};
+}
+
+__attribute__((target("avx2")))
+static TrendSums sumsAVX2(const float* y, std::size_t count, double firstX)
+{
+    __m256d sumY = _mm256_setzero_pd();
+    __m256d sumXY = _mm256_setzero_pd();
+    __m256d xLow = _mm256_set_pd(firstX + 3.0, firstX + 2.0, firstX + 1.0, firstX);
+    __m256d xHigh = _mm256_add_pd(xLow, _mm256_set1_pd(4.0));
+    const __m256d step = _mm256_set1_pd(8.0);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m256d low = _mm256_cvtps_pd(_mm_loadu_ps(&y[i]));
+        const __m256d high = _mm256_cvtps_pd(_mm_loadu_ps(&y[i + 4]));
+
+        sumY = _mm256_add_pd(sumY, _mm256_add_pd(low, high));
+        sumXY = _mm256_add_pd(sumXY, _mm256_add_pd(_mm256_mul_pd(xLow, low), _mm256_mul_pd(xHigh, high)));
+        xLow = _mm256_add_pd(xLow, step);
+        xHigh = _mm256_add_pd(xHigh, step);
+    }
+
+    const __m128d y2 = _mm_add_pd(_mm256_castpd256_pd128(sumY), _mm256_extractf128_pd(sumY, 1));
+    const __m128d xy2 = _mm_add_pd(_mm256_castpd256_pd128(sumXY), _mm256_extractf128_pd(sumXY, 1));
+    TrendSums tail = sumsScalar(&y[i], count - i, firstX + static_cast<double>(i));
+    return TrendSums{horizontalSum(y2) + tail.y, horizontalSum(xy2) + tail.xy};
+}
+#endif
+
+static bool isSupported(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::Scalar:
+            return true;
+#ifdef WEATHER_FORECAST_X86
+        case KernelFlavor::SSE:
+            return __builtin_cpu_supports("sse2");
+        case KernelFlavor::AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        default:
+            return false;
+#endif
+    }
+    return false;
+}
+
+static KernelFlavor bestFlavor()
+{
+    for(KernelFlavor flavor : {KernelFlavor::AVX2, KernelFlavor::SSE})
+    {
+        if(isSupported(flavor))
+        {
+            return flavor;
+        }
+    }
+    return KernelFlavor::Scalar;
+}
+
+static const char* flavorName(KernelFlavor flavor)
+{
+    switch(flavor)
+    {
+        case KernelFlavor::SSE:
+            return "SSE";
+        case KernelFlavor::AVX2:
+            return "AVX2";
+        case KernelFlavor::Scalar:
+            break;
+    }
+    return "scalar";
+}
+
+static TrendSums trendSums(KernelFlavor flavor, const float* y, std::size_t count, double firstX)
+{
+    switch(flavor)
+    {
+#ifdef WEATHER_FORECAST_X86
+        case KernelFlavor::AVX2:
+            return sumsAVX2(y, count, firstX);
+        case KernelFlavor::SSE:
+            return sumsSSE(y, count, firstX);
+#endif
+        default:
+            return sumsScalar(y, count, firstX);
+    }
+}
+
+static const KernelFlavor refitFlavor = bestFlavor();
+
+/* *********************************************
+* Least-squares trend over the newest `capacity`
+* samples. x is the position in the window, 0 for the
+* oldest sample, so sum(x) and sum(x*x) only depend on
+* the count and are not stored.
+*
+* The incremental sums pick up rounding error over
+* time, so they are replaced by a refit every
+* refitInterval samples, which is O(1) amortized.
+********************************************* */
+
+class TrendWindow {
+
+    public:
+        static constexpr std::uint64_t refitInterval = 1u << 20;
+
+        explicit TrendWindow(std::size_t capacity) : m_values(std::max<std::size_t>(2, capacity)), m_next(0), m_count(0),
+            m_sumY(0.0), m_sumXY(0.0), m_sinceRefit(0)
+        {
+
+        }
+
+        void add(float y) {
+            if(m_count == m_values.size())
+            {
+                // the oldest sample leaves and everybody else moves one step to the left
+                const double oldest = m_values[m_next];
+                m_sumY -= oldest;
+                m_sumXY -= m_sumY;
+                --m_count;
+            }
+
+            m_sumXY += static_cast<double>(m_count) * y;
+            m_sumY += y;
+            ++m_count;
+
+            m_values[m_next] = y;
+            if(++m_next == m_values.size())
+            {
+                m_next = 0;
+            }
+
+            if(++m_sinceRefit == refitInterval)
+            {
+                refit(refitFlavor);
+            }
+        }
+
+        // Keeps the newest samples that still fit and refits over them.
+        void resize(std::size_t capacity) {
+            capacity = std::max<std::size_t>(2, capacity);
+            std::vector<float> values(capacity);
+            const std::size_t kept = std::min(capacity, m_count);
+            for(std::size_t i = 0; i < kept; ++i)
+            {
+                values[i] = at(m_count - kept + i);
+            }
+            m_values.swap(values);
+            m_count = kept;
+            m_next = kept == capacity ? 0 : kept;
+            refit(refitFlavor);
+        }
+
+        // Recomputes the sums from the buffer, the oldest run first.
+        void refit(KernelFlavor flavor) {
+            const std::size_t oldest = oldestIndex();
+            const std::size_t firstRun = std::min(m_count, m_values.size() - oldest);
+
+            TrendSums first = trendSums(flavor, &m_values[oldest], firstRun, 0.0);
+            TrendSums second = trendSums(flavor, m_values.data(), m_count - firstRun, static_cast<double>(firstRun));
+            m_sumY = first.y + second.y;
+            m_sumXY = first.xy + second.xy;
+            m_sinceRefit = 0;
+        }
+
+        // Change per sample of the fitted line.
+        double slope() const {
+            if(m_count < 2)
+            {
+                return 0.0;
+            }
+            const double n = static_cast<double>(m_count);
+            const double sumX = n * (n - 1.0) / 2.0;
+            const double sumXX = (n - 1.0) * n * (2.0 * n - 1.0) / 6.0;
+            return (n * m_sumXY - sumX * m_sumY) / (n * sumXX - sumX * sumX);
+        }
+
+        // Value of the fitted line `steps` samples after the newest one.
+        double forecast(double steps) const {
+            if(m_count == 0)
+            {
+                return 0.0;
+            }
+            const double n = static_cast<double>(m_count);
+            const double mean = m_sumY / n;
+            return mean + slope() * ((n - 1.0) / 2.0 + steps);
+        }
+
+        std::size_t count() const {
+            return m_count;
+        }
+
+        std::size_t capacity() const {
+            return m_values.size();
+        }
+
+    private:
+        std::size_t oldestIndex() const {
+            return (m_next + m_values.size() - m_count) % m_values.size();
+        }
+
+        // i-th sample of the window, 0 is the oldest.
+        float at(std::size_t i) const {
+            return m_values[(oldestIndex() + i) % m_values.size()];
+        }
+
+        std::vector<float> m_values;
+        std::size_t m_next;
+        std::size_t m_count;
+        double m_sumY;
+        double m_sumXY;
+        std::uint64_t m_sinceRefit;
+};
+
+class ForecastDisplay : public Observer, public DisplayElement {
+    private:
+        TrendWindow m_pressure;
+        TrendWindow m_temperature;
+        Subject* m_weatherData;
+
+    public:
+        ForecastDisplay(Subject* weatherData, std::size_t window) : m_pressure(window), m_temperature(window), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        ForecastDisplay(const ForecastDisplay&) = default;
+        ForecastDisplay& operator=(const ForecastDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            m_pressure.add(pressure);
+            m_temperature.add(temperature);
+            display();
+        }
+
+        void resize(std::size_t window) {
+            m_pressure.resize(window);
+            m_temperature.resize(window);
+        }
+
+        void display() override {
+            const double pressureTrend = m_pressure.slope();
+            std::cout << "Forecast: ";
+            if(pressureTrend > 0.01)
+            {
+                std::cout << "Improving weather on the way!";
+            }
+            else if(pressureTrend < -0.01)
+            {
+                std::cout << "Watch out for cooler, rainy weather";
+            }
+            else
+            {
+                std::cout << "More of the same";
+            }
+            std::cout << " (next reading about " << m_temperature.forecast(1.0) << "°C)" << std::endl;
+        }
+
+};
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with an incremental forecast display" << std::endl;
+
+    {
+        WeatherData weatherData;
+        ForecastDisplay forecastDisplay(&weatherData, 8);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.4);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        weatherData.setMeasurements(22.0, 50.0, 28.9);
+
+        forecastDisplay.resize(2);
+        std::cout << "window resized to 2 readings" << std::endl;
+        weatherData.setMeasurements(21.0, 52.0, 28.9);
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 4096 stations with a window of 256
+    * pressures each, fed for 200 ticks after warm up.
+    * Incremental updates are compared with a full refit
+    * after every update, scalar and SIMD.
+    ********************************************* */
+
+    const std::size_t stations = 4096;
+    const std::size_t window = 256;
+    const int ticks = 200;
+
+    std::mt19937 random(3);
+    std::normal_distribution<float> noise(0.0f, 0.5f);
+    std::vector<float> readings(static_cast<std::size_t>(ticks) * stations);
+    for(std::size_t i = 0; i < readings.size(); ++i)
+    {
+        readings[i] = 1013.0f + 0.001f * static_cast<float>(i / stations) + noise(random);
+    }
+
+    std::vector<TrendWindow> warm;
+    warm.reserve(stations);
+    for(std::size_t s = 0; s < stations; ++s)
+    {
+        warm.emplace_back(window);
+        for(std::size_t i = 0; i < window; ++i)
+        {
+            warm.back().add(1013.0f + noise(random));
+        }
+    }
+
+    std::cout << "stations: " << stations << ", window: " << window << ", ticks: " << ticks
+              << ", best refit kernel: " << flavorName(refitFlavor) << std::endl;
+
+    std::vector<double> incrementalForecasts;
+    double incrementalNanoseconds = 0.0;
+    for(int mode = 0; mode < 4; ++mode)
+    {
+        const bool incremental = mode == 0;
+        const KernelFlavor flavor = mode == 1 ? KernelFlavor::Scalar : mode == 2 ? KernelFlavor::SSE : KernelFlavor::AVX2;
+        if(!incremental && !isSupported(flavor))
+        {
+            continue;
+        }
+
+        std::vector<TrendWindow> windows(warm);
+        std::vector<double> forecasts(stations);
+
+        auto start = std::chrono::steady_clock::now();
+        for(int tick = 0; tick < ticks; ++tick)
+        {
+            for(std::size_t s = 0; s < stations; ++s)
+            {
+                TrendWindow& trend = windows[s];
+                trend.add(readings[static_cast<std::size_t>(tick) * stations + s]);
+                if(!incremental)
+                {
+                    trend.refit(flavor);
+                }
+                forecasts[s] = trend.forecast(10.0);
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        const double nanoseconds = std::chrono::duration<double, std::nano>(stop - start).count() / (ticks * stations);
+
+        double worst = 0.0;
+        if(incremental)
+        {
+            incrementalForecasts = forecasts;
+            incrementalNanoseconds = nanoseconds;
+        }
+        else
+        {
+            for(std::size_t s = 0; s < stations; ++s)
+            {
+                worst = std::max(worst, std::abs(forecasts[s] - incrementalForecasts[s]));
+            }
+        }
+
+        std::cout << (incremental ? std::string("incremental") : std::string("full refit, ") + flavorName(flavor))
+                  << ": " << nanoseconds << " ns per update";
+        if(!incremental)
+        {
+            std::cout << " (" << nanoseconds / incrementalNanoseconds << "x incremental), largest difference "
+                      << worst << " hPa";
+        }
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,842 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with a history display that keeps every
+* measurement in a compressed time series, the way
+* Facebook's Gorilla does:
+*
+* - timestamps as delta of delta, a single bit when
+*   the sampling interval did not change,
+* - every value XORed with the previous one of its
+*   field, a single bit when it did not change and
+*   otherwise only the bits between the leading and
+*   trailing zeros.
+*
+* Samples go into append-only blocks that are cut on
+* whole hours (and after 4096 samples at most). Each
+* block knows its time range and the min/max/sum of
+* its values, so range scans skip whole blocks and a
+* downsampling query with hour aligned buckets of an
+* hour or more is answered from the summaries alone;
+* only blocks that straddle a bucket boundary are
+* decoded.
+*
+* The program compares memory per sample and query
+* speed with a plain std::vector of structs.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <array>
+#include <vector>
+#include <list>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+};
+
+// Timestamps are milliseconds.
+struct Sample {
+    std::int64_t time;
+    std::array<float, 3> values;
+};
+
+struct FieldSummary {
+    float min;
+    float max;
+    double sum;
+
+    static FieldSummary empty() {
+        return FieldSummary{std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0.0};
+    }
+
+    void add(float value) {
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += value;
+    }
+
+    void merge(const FieldSummary& other) {
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+    }
+};
+
+// One bucket of a downsampling query: [start, start + width).
+struct Bucket {
+    std::int64_t start;
+    std::uint64_t count;
+    std::array<FieldSummary, 3> fields;
+};
+
+// The buckets that cover [from, to), all empty. Throws for a width that is not positive.
+static std::vector<Bucket> emptyBuckets(std::int64_t from, std::int64_t to, std::int64_t width)
+{
+    if(width <= 0)
+    {
+        throw std::invalid_argument("bucket width must be positive");
+    }
+    std::vector<Bucket> buckets;
+    if(from >= to)
+    {
+        return buckets;
+    }
+    // unsigned, so that neither to - from nor the start of the last bucket can overflow
+    const std::uint64_t span = static_cast<std::uint64_t>(to) - static_cast<std::uint64_t>(from);
+    const std::uint64_t count = (span - 1) / static_cast<std::uint64_t>(width) + 1;
+    buckets.reserve(static_cast<std::size_t>(count));
+    for(std::uint64_t i = 0; i < count; ++i)
+    {
+        const std::int64_t start = static_cast<std::int64_t>(static_cast<std::uint64_t>(from) + i * static_cast<std::uint64_t>(width));
+        buckets.push_back(Bucket{start, 0, {FieldSummary::empty(), FieldSummary::empty(), FieldSummary::empty()}});
+    }
+    return buckets;
+}
+
+// The bucket of `time`, which must be in [from, to) of the query.
+static std::size_t bucketOf(std::int64_t from, std::int64_t time, std::int64_t width)
+{
+    return static_cast<std::size_t>((static_cast<std::uint64_t>(time) - static_cast<std::uint64_t>(from)) / static_cast<std::uint64_t>(width));
+}
+
+/* *********************************************
+* Bit streams, most significant bit first, in 64 bit
+* words.
+********************************************* */
+
+static std::uint64_t lowBits(unsigned count)
+{
+    return count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1;
+}
+
+class BitWriter {
+
+    public:
+        BitWriter() : m_words(), m_free(0)
+        {
+
+        }
+
+        void write(std::uint64_t bits, unsigned count) {
+            if(count == 0)
+            {
+                return;
+            }
+            bits &= lowBits(count);
+            if(m_free == 0)
+            {
+                m_words.push_back(0);
+                m_free = 64;
+            }
+            if(count <= m_free)
+            {
+                m_words.back() |= bits << (m_free - count);
+                m_free -= count;
+                return;
+            }
+            const unsigned spill = count - m_free;
+            m_words.back() |= bits >> spill;
+            m_words.push_back(bits << (64 - spill));
+            m_free = 64 - spill;
+        }
+
+        const std::vector<std::uint64_t>& words() const {
+            return m_words;
+        }
+
+        void shrink() {
+            m_words.shrink_to_fit();
+        }
+
+        std::size_t bytes() const {
+            return m_words.capacity() * sizeof(std::uint64_t);
+        }
+
+    private:
+        std::vector<std::uint64_t> m_words;
+        unsigned m_free;
+};
+
+class BitReader {
+
+    public:
+        explicit BitReader(const std::vector<std::uint64_t>& words) : m_words(words.data()), m_position(0)
+        {
+
+        }
+
+        std::uint64_t read(unsigned count) {
+            if(count == 0)
+            {
+                return 0;
+            }
+            const std::uint64_t word = m_words[m_position / 64];
+            const unsigned offset = static_cast<unsigned>(m_position % 64);
+            const unsigned available = 64 - offset;
+            m_position += count;
+            if(count <= available)
+            {
+                return (word >> (available - count)) & lowBits(count);
+            }
+            const unsigned spill = count - available;
+            return ((word & lowBits(available)) << spill) | (m_words[(m_position - 1) / 64] >> (64 - spill));
+        }
+
+        bool readBit() {
+            return read(1) != 0;
+        }
+
+    private:
+        const std::uint64_t* m_words;
+        std::size_t m_position;
+};
+
+/* *********************************************
+* Encoder and decoder state of one field: the last
+* value and the window of meaningful bits the last
+* XOR used. They must evolve the same way on both
+* sides, so both call the same update.
+********************************************* */
+
+struct XorState {
+    std::uint32_t previous;
+    unsigned leading;
+    unsigned trailing;
+    bool hasWindow;
+};
+
+static std::uint32_t floatBits(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(std::uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void encodeValue(BitWriter& out, XorState& state, float value)
+{
+    const std::uint32_t bits = floatBits(value);
+    const std::uint32_t x = bits ^ state.previous;
+    state.previous = bits;
+    if(x == 0)
+    {
+        out.write(0, 1);
+        return;
+    }
+
+    const unsigned leading = std::min(31u, static_cast<unsigned>(__builtin_clz(x)));
+    const unsigned trailing = static_cast<unsigned>(__builtin_ctz(x));
+    if(state.hasWindow && leading >= state.leading && trailing >= state.trailing)
+    {
+        // fits in the previous window, no need to repeat its size
+        out.write(0b10, 2);
+        out.write(x >> state.trailing, 32 - state.leading - state.trailing);
+        return;
+    }
+
+    const unsigned length = 32 - leading - trailing;
+    out.write(0b11, 2);
+    out.write(leading, 5);
+    out.write(length - 1, 5);
+    out.write(x >> trailing, length);
+    state.leading = leading;
+    state.trailing = trailing;
+    state.hasWindow = true;
+}
+
+static float decodeValue(BitReader& in, XorState& state)
+{
+    if(!in.readBit())
+    {
+        return bitsFloat(state.previous);
+    }
+    std::uint32_t x;
+    if(!in.readBit())
+    {
+        x = static_cast<std::uint32_t>(in.read(32 - state.leading - state.trailing)) << state.trailing;
+    }
+    else
+    {
+        const unsigned leading = static_cast<unsigned>(in.read(5));
+        const unsigned length = static_cast<unsigned>(in.read(5)) + 1;
+        const unsigned trailing = 32 - leading - length;
+        x = static_cast<std::uint32_t>(in.read(length)) << trailing;
+        state.leading = leading;
+        state.trailing = trailing;
+        state.hasWindow = true;
+    }
+    state.previous ^= x;
+    return bitsFloat(state.previous);
+}
+
+// Delta of delta in buckets of 1, 2+7, 3+9, 4+12 and 4+64 bits.
+static void encodeTime(BitWriter& out, std::int64_t deltaOfDelta)
+{
+    if(deltaOfDelta == 0)
+    {
+        out.write(0, 1);
+    }
+    else if(deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        out.write(0b10, 2);
+        out.write(static_cast<std::uint64_t>(deltaOfDelta + 63), 7);
+    }
+    else if(deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        out.write(0b110, 3);
+        out.write(static_cast<std::uint64_t>(deltaOfDelta + 255), 9);
+    }
+    else if(deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        out.write(0b1110, 4);
+        out.write(static_cast<std::uint64_t>(deltaOfDelta + 2047), 12);
+    }
+    else
+    {
+        out.write(0b1111, 4);
+        out.write(static_cast<std::uint64_t>(deltaOfDelta), 64);
+    }
+}
+
+static std::int64_t decodeTime(BitReader& in)
+{
+    if(!in.readBit())
+    {
+        return 0;
+    }
+    if(!in.readBit())
+    {
+        return static_cast<std::int64_t>(in.read(7)) - 63;
+    }
+    if(!in.readBit())
+    {
+        return static_cast<std::int64_t>(in.read(9)) - 255;
+    }
+    if(!in.readBit())
+    {
+        return static_cast<std::int64_t>(in.read(12)) - 2047;
+    }
+    return static_cast<std::int64_t>(in.read(64));
+}
+
+/* *********************************************
+* Append-only store. Samples must arrive in time
+* order, an older one is refused: the block index is
+* searched by start time. A block covers at most one blockSpan of time,
+* starting on a multiple of it, and up to blockSamples
+* samples; the first sample of a block is encoded
+* against zeros, so every block decodes on its own.
+********************************************* */
+
+class HistoryStore {
+
+    public:
+        static constexpr std::uint32_t blockSamples = 4096;
+        static constexpr std::int64_t blockSpan = 3600000;
+
+        HistoryStore() : m_blocks(), m_encoder()
+        {
+
+        }
+
+        // Returns false, and drops the sample, if it is older than the last one appended.
+        bool append(std::int64_t time, float temperature, float humidity, float pressure) {
+            if(!m_blocks.empty() && time < m_blocks.back().lastTime)
+            {
+                return false;
+            }
+            if(m_blocks.empty() || m_blocks.back().count == blockSamples
+               || spanOf(time) != spanOf(m_blocks.back().firstTime))
+            {
+                if(!m_blocks.empty())
+                {
+                    m_blocks.back().bits.shrink();
+                }
+                m_blocks.emplace_back();
+                m_blocks.back().firstTime = time;
+                m_encoder = Encoder();
+                m_encoder.lastTime = time;
+            }
+
+            Block& block = m_blocks.back();
+            const std::int64_t delta = time - m_encoder.lastTime;
+            encodeTime(block.bits, delta - m_encoder.lastDelta);
+            m_encoder.lastTime = time;
+            m_encoder.lastDelta = delta;
+
+            const std::array<float, 3> values{temperature, humidity, pressure};
+            for(std::size_t field = 0; field < values.size(); ++field)
+            {
+                encodeValue(block.bits, m_encoder.fields[field], values[field]);
+                block.summaries[field].add(values[field]);
+            }
+            block.lastTime = time;
+            ++block.count;
+            return true;
+        }
+
+        // Visits every sample with from <= time < to, in time order.
+        void scan(std::int64_t from, std::int64_t to, const std::function<void(const Sample&)>& visit) const {
+            for(const Block& block : firstBlocksFrom(from))
+            {
+                if(block.firstTime >= to)
+                {
+                    break;
+                }
+                decode(block, [&](const Sample& sample){
+                    if(sample.time >= from && sample.time < to)
+                    {
+                        visit(sample);
+                    }
+                });
+            }
+        }
+
+        // Min/max/sum per bucket of `width` (> 0) milliseconds in [from, to). If given, `summarised`
+        // receives the number of blocks answered from their summary without decoding.
+        std::vector<Bucket> downsample(std::int64_t from, std::int64_t to, std::int64_t width,
+                                       std::size_t* summarised = nullptr) const {
+            std::vector<Bucket> buckets = emptyBuckets(from, to, width);
+
+            std::size_t fromSummaries = 0;
+            for(const Block& block : firstBlocksFrom(from))
+            {
+                if(block.firstTime >= to)
+                {
+                    break;
+                }
+                if(block.firstTime >= from && block.lastTime < to
+                   && bucketOf(from, block.firstTime, width) == bucketOf(from, block.lastTime, width))
+                {
+                    // the whole block falls into one bucket, its summary is enough
+                    Bucket& bucket = buckets[bucketOf(from, block.firstTime, width)];
+                    bucket.count += block.count;
+                    for(std::size_t field = 0; field < 3; ++field)
+                    {
+                        bucket.fields[field].merge(block.summaries[field]);
+                    }
+                    ++fromSummaries;
+                    continue;
+                }
+                decode(block, [&](const Sample& sample){
+                    if(sample.time >= from && sample.time < to)
+                    {
+                        Bucket& bucket = buckets[bucketOf(from, sample.time, width)];
+                        ++bucket.count;
+                        for(std::size_t field = 0; field < 3; ++field)
+                        {
+                            bucket.fields[field].add(sample.values[field]);
+                        }
+                    }
+                });
+            }
+            if(summarised)
+            {
+                *summarised = fromSummaries;
+            }
+            return buckets;
+        }
+
+        std::size_t bytes() const {
+            std::size_t total = sizeof(*this) + m_blocks.capacity() * sizeof(Block);
+            for(const Block& block : m_blocks)
+            {
+                total += block.bits.bytes();
+            }
+            return total;
+        }
+
+        std::size_t blocks() const {
+            return m_blocks.size();
+        }
+
+    private:
+        struct Block {
+            std::int64_t firstTime;
+            std::int64_t lastTime;
+            std::uint32_t count;
+            std::array<FieldSummary, 3> summaries;
+            BitWriter bits;
+
+            Block() : firstTime(0), lastTime(0), count(0),
+                summaries{FieldSummary::empty(), FieldSummary::empty(), FieldSummary::empty()}, bits()
+            {
+
+            }
+        };
+
+        struct Encoder {
+            std::int64_t lastTime;
+            std::int64_t lastDelta;
+            std::array<XorState, 3> fields;
+
+            Encoder() : lastTime(0), lastDelta(0), fields()
+            {
+
+            }
+        };
+
+        // Blocks from the last one that starts at or before `from` to the end.
+        struct BlockRange {
+            const Block* first;
+            const Block* last;
+
+            const Block* begin() const {
+                return first;
+            }
+
+            const Block* end() const {
+                return last;
+            }
+        };
+
+        // floor(time / blockSpan), also for times before zero
+        static std::int64_t spanOf(std::int64_t time) {
+            return time >= 0 ? time / blockSpan : -((-time - 1) / blockSpan) - 1;
+        }
+
+        BlockRange firstBlocksFrom(std::int64_t from) const {
+            const Block* begin = m_blocks.data();
+            const Block* end = m_blocks.data() + m_blocks.size();
+            const Block* found = std::upper_bound(begin, end, from,
+                [](std::int64_t time, const Block& block){ return time < block.firstTime; });
+            return BlockRange{found == begin ? begin : found - 1, end};
+        }
+
+        template<typename Visit>
+        static void decode(const Block& block, Visit&& visit) {
+            BitReader in(block.bits.words());
+            std::array<XorState, 3> fields{};
+            Sample sample{block.firstTime, {0.0f, 0.0f, 0.0f}};
+            std::int64_t delta = 0;
+            for(std::uint32_t i = 0; i < block.count; ++i)
+            {
+                delta += decodeTime(in);
+                sample.time += delta;
+                for(std::size_t field = 0; field < 3; ++field)
+                {
+                    sample.values[field] = decodeValue(in, fields[field]);
+                }
+                visit(sample);
+            }
+        }
+
+        std::vector<Block> m_blocks;
+        Encoder m_encoder;
+};
+
+// The baseline: every sample as a struct in one vector.
+class VectorHistory {
+
+    public:
+        VectorHistory() : m_samples()
+        {
+
+        }
+
+        bool append(std::int64_t time, float temperature, float humidity, float pressure) {
+            if(!m_samples.empty() && time < m_samples.back().time)
+            {
+                return false;
+            }
+            m_samples.push_back(Sample{time, {temperature, humidity, pressure}});
+            return true;
+        }
+
+        void scan(std::int64_t from, std::int64_t to, const std::function<void(const Sample&)>& visit) const {
+            auto first = std::lower_bound(m_samples.begin(), m_samples.end(), from,
+                [](const Sample& sample, std::int64_t time){ return sample.time < time; });
+            for(auto it = first; it != m_samples.end() && it->time < to; ++it)
+            {
+                visit(*it);
+            }
+        }
+
+        std::vector<Bucket> downsample(std::int64_t from, std::int64_t to, std::int64_t width) const {
+            std::vector<Bucket> buckets = emptyBuckets(from, to, width);
+            scan(from, to, [&](const Sample& sample){
+                Bucket& bucket = buckets[bucketOf(from, sample.time, width)];
+                ++bucket.count;
+                for(std::size_t field = 0; field < 3; ++field)
+                {
+                    bucket.fields[field].add(sample.values[field]);
+                }
+            });
+            return buckets;
+        }
+
+        std::size_t bytes() const {
+            // what the samples need, not counting the slack a growing vector keeps
+            return sizeof(*this) + m_samples.size() * sizeof(Sample);
+        }
+
+    private:
+        std::vector<Sample> m_samples;
+};
+
+// Milliseconds since the display was created, from the steady clock.
+static std::function<std::int64_t()> steadyMilliseconds()
+{
+    const auto start = std::chrono::steady_clock::now();
+    return [start](){
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+}
+
+class HistoryDisplay : public Observer, public DisplayElement {
+    private:
+        HistoryStore m_history;
+        std::function<std::int64_t()> m_clock;
+        Subject* m_weatherData;
+
+    public:
+        // `clock` stamps every sample in milliseconds; it must never go backwards.
+        HistoryDisplay(Subject* weatherData, std::function<std::int64_t()> clock = steadyMilliseconds())
+            : m_history(), m_clock(std::move(clock)), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        HistoryDisplay(const HistoryDisplay&) = default;
+        HistoryDisplay& operator=(const HistoryDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_history.append(m_clock(), temperature, humidity, pressure);
+        }
+
+        void display() override {
+            m_history.scan(std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max(), [](const Sample& sample){
+                std::cout << "History: at " << sample.time << " ms " << sample.values[0] << "°C, "
+                          << sample.values[1] << "% humidity, " << sample.values[2] << " inHg" << std::endl;
+            });
+        }
+
+        const HistoryStore& history() const {
+            return m_history;
+        }
+
+};
+
+static bool sameBuckets(const std::vector<Bucket>& left, const std::vector<Bucket>& right)
+{
+    if(left.size() != right.size())
+    {
+        return false;
+    }
+    for(std::size_t i = 0; i < left.size(); ++i)
+    {
+        if(left[i].count != right[i].count)
+        {
+            return false;
+        }
+        for(std::size_t field = 0; field < 3; ++field)
+        {
+            const FieldSummary& a = left[i].fields[field];
+            const FieldSummary& b = right[i].fields[field];
+            // sums are added up in a different order when a block summary is used
+            if(a.min != b.min || a.max != b.max || std::abs(a.sum - b.sum) > 1e-9 * std::abs(b.sum))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<typename Function>
+static double measureMilliseconds(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with a compressed history" << std::endl;
+
+    {
+        // the book's readings, one a second
+        WeatherData weatherData;
+        std::int64_t now = 0;
+        HistoryDisplay historyDisplay(&weatherData, [&now](){ return now += 1000; });
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        historyDisplay.display();
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Thirty days of one reading per second from a
+    * station with the usual sensor resolution: 0.1 °C,
+    * 1 % humidity and 0.01 inHg, and a clock that is a
+    * millisecond off now and then.
+    ********************************************* */
+
+    const std::size_t samples = 30 * 24 * 3600;
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    HistoryStore compressed;
+    VectorHistory plain;
+    std::int64_t time = 1700000000000;
+    int temperature = 200;
+    int humidity = 55;
+    int pressure = 2920;
+
+    double appendCompressed = 0.0;
+    double appendPlain = 0.0;
+    {
+        std::vector<Sample> generated;
+        generated.reserve(samples);
+        for(std::size_t i = 0; i < samples; ++i)
+        {
+            time += 1000 + (chance(random) < 0.05 ? (chance(random) < 0.5 ? -1 : 1) : 0);
+            temperature += chance(random) < 0.1 ? (chance(random) < 0.5 ? -1 : 1) : 0;
+            humidity += chance(random) < 0.02 ? (chance(random) < 0.5 ? -1 : 1) : 0;
+            pressure += chance(random) < 0.05 ? (chance(random) < 0.5 ? -1 : 1) : 0;
+            generated.push_back(Sample{time, {static_cast<float>(temperature) / 10.0f, static_cast<float>(humidity),
+                                              static_cast<float>(pressure) / 100.0f}});
+        }
+
+        appendCompressed = measureMilliseconds([&](){
+            for(const Sample& sample : generated)
+            {
+                compressed.append(sample.time, sample.values[0], sample.values[1], sample.values[2]);
+            }
+        });
+        appendPlain = measureMilliseconds([&](){
+            for(const Sample& sample : generated)
+            {
+                plain.append(sample.time, sample.values[0], sample.values[1], sample.values[2]);
+            }
+        });
+    }
+
+    const std::int64_t first = 1700000000000;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << samples << " samples in " << compressed.blocks() << " blocks" << std::endl;
+    std::cout << "memory: compressed " << static_cast<double>(compressed.bytes()) / samples << " bytes/sample, vector "
+              << static_cast<double>(plain.bytes()) / samples << " bytes/sample" << std::endl;
+    std::cout << "append: compressed " << appendCompressed * 1e6 / samples << " ns/sample, vector "
+              << appendPlain * 1e6 / samples << " ns/sample" << std::endl;
+
+    // a full scan and one day in the middle
+    const std::int64_t day = 86400000;
+    using Range = std::pair<std::int64_t, std::int64_t>;
+    for(const Range& range : {Range(first, time + 1), Range(first + 10 * day, first + 11 * day)})
+    {
+        std::uint64_t compressedCount = 0;
+        std::uint64_t plainCount = 0;
+        double compressedSum = 0.0;
+        double plainSum = 0.0;
+        double compressedMs = measureMilliseconds([&](){
+            compressed.scan(range.first, range.second, [&](const Sample& sample){ ++compressedCount; compressedSum += sample.values[0]; });
+        });
+        double plainMs = measureMilliseconds([&](){
+            plain.scan(range.first, range.second, [&](const Sample& sample){ ++plainCount; plainSum += sample.values[0]; });
+        });
+        std::cout << "scan of " << plainCount << " samples: compressed " << compressedCount / compressedMs / 1e3
+                  << "M samples/s, vector " << plainCount / plainMs / 1e3 << "M samples/s, "
+                  << (compressedCount == plainCount && compressedSum == plainSum ? "same samples" : "RESULTS DIFFER") << std::endl;
+    }
+
+    /* *********************************************
+    * Daily, hourly and per-minute min/max/avg over the
+    * whole month, buckets aligned to midnight. Blocks
+    * are whole hours, so daily and hourly buckets come
+    * from the block summaries; per-minute buckets are
+    * narrower than a block and decode every sample.
+    ********************************************* */
+
+    const std::int64_t midnight = first / day * day;
+    for(std::int64_t width : {day, std::int64_t(3600000), std::int64_t(60000)})
+    {
+        std::vector<Bucket> compressedBuckets;
+        std::vector<Bucket> plainBuckets;
+        std::size_t summarised = 0;
+        double compressedMs = measureMilliseconds([&](){ compressedBuckets = compressed.downsample(midnight, time + 1, width, &summarised); });
+        double plainMs = measureMilliseconds([&](){ plainBuckets = plain.downsample(midnight, time + 1, width); });
+        std::cout << "downsample to " << width / 1000 << " s buckets: compressed " << compressedMs << " ms ("
+                  << summarised << " of " << compressed.blocks() << " blocks from summaries), vector "
+                  << plainMs << " ms, " << (sameBuckets(compressedBuckets, plainBuckets) ? "same buckets" : "RESULTS DIFFER")
+                  << std::endl;
+    }
+}
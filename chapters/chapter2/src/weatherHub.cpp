@@ -0,0 +1,623 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern for many stations in one process. A
+* WeatherHub hosts every station; stations are split
+* over shards by id (station % shards) and every shard
+* has one worker thread that owns its stations, their
+* observer lists and their part of the regional sums.
+* A station's updates are therefore always handled on
+* the same thread.
+*
+* Producers do not share a queue: every producer has
+* one single-producer/single-consumer ring per shard,
+* so the hot path has no locks and no shared writes.
+*
+* Regional views aggregate across shards. Each shard
+* keeps running sums per region for its own stations;
+* publishRegions() adds the shard sums up and notifies
+* the regional observers with the averages.
+*
+* Observers are registered while the hub is stopped.
+*
+* Usage: chapter2_9 [max threads]
+* (shard workers plus producer threads at the top of
+* the benchmark curve, 2 at least)
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+using StationId = std::uint32_t;
+
+struct StationUpdate {
+    StationId station;
+    float temperature;
+    float humidity;
+    float pressure;
+};
+
+/* *********************************************
+* Bounded single-producer/single-consumer ring. The
+* two indices live on their own cache lines and each
+* side keeps a cached copy of the other one, so the
+* shared lines are only touched when the cache says
+* the ring looks full (or empty).
+********************************************* */
+
+class UpdateRing {
+
+    public:
+        static constexpr std::size_t capacity = 4096;
+
+        UpdateRing() : m_slots(capacity), m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+        {
+
+        }
+
+        UpdateRing(const UpdateRing&) = delete;
+        UpdateRing& operator=(const UpdateRing&) = delete;
+
+        bool push(const StationUpdate& update) {
+            const std::uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            if(tail - m_cachedHead == capacity)
+            {
+                m_cachedHead = m_head.load(std::memory_order_acquire);
+                if(tail - m_cachedHead == capacity)
+                {
+                    return false;
+                }
+            }
+            m_slots[tail & (capacity - 1)] = update;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Hands up to `limit` updates to `consume`, returns how many.
+        template<typename Consume>
+        std::size_t popBatch(std::size_t limit, Consume&& consume) {
+            const std::uint64_t head = m_head.load(std::memory_order_relaxed);
+            if(head == m_cachedTail)
+            {
+                m_cachedTail = m_tail.load(std::memory_order_acquire);
+                if(head == m_cachedTail)
+                {
+                    return 0;
+                }
+            }
+            const std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(limit, m_cachedTail - head));
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                consume(m_slots[(head + i) & (capacity - 1)]);
+            }
+            m_head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+    private:
+        std::vector<StationUpdate> m_slots;
+        // consumer side
+        alignas(64) std::atomic<std::uint64_t> m_head;
+        std::uint64_t m_cachedTail;
+        // producer side
+        alignas(64) std::atomic<std::uint64_t> m_tail;
+        std::uint64_t m_cachedHead;
+};
+
+/* *********************************************
+* Running sums of one region inside one shard. Only
+* the shard worker writes them; publishRegions reads
+* them from another thread, hence the atomics (all
+* relaxed, a view may be a few updates behind).
+********************************************* */
+
+struct alignas(64) RegionSums {
+    std::atomic<double> temperature;
+    std::atomic<double> humidity;
+    std::atomic<double> pressure;
+    std::atomic<std::uint32_t> stations;
+
+    RegionSums() : temperature(0.0), humidity(0.0), pressure(0.0), stations(0)
+    {
+
+    }
+};
+
+class WeatherHub {
+
+    public:
+        class Producer;
+
+        WeatherHub(std::size_t stations, std::size_t shards, std::size_t stationsPerRegion)
+            : m_stationCount(stations), m_stationsPerRegion(std::max<std::size_t>(1, stationsPerRegion)),
+              m_shards(), m_producers(), m_regionObservers((stations + m_stationsPerRegion - 1) / m_stationsPerRegion),
+              m_running(false)
+        {
+            shards = std::max<std::size_t>(1, shards);
+            for(std::size_t s = 0; s < shards; ++s)
+            {
+                m_shards.push_back(std::make_unique<Shard>(*this, s, shards));
+            }
+        }
+
+        ~WeatherHub() {
+            stop();
+        }
+
+        WeatherHub(const WeatherHub&) = delete;
+        WeatherHub& operator=(const WeatherHub&) = delete;
+
+        // Feeds updates from one thread. Only valid while the hub is stopped.
+        Producer& addProducer();
+
+        void registerObserver(StationId station, Observer* o) {
+            requireStopped();
+            shardOf(station).station(station).observers.push_back(o);
+        }
+
+        void registerRegionObserver(std::size_t region, Observer* o) {
+            requireStopped();
+            m_regionObservers.at(region).push_back(o);
+        }
+
+        void start() {
+            requireStopped();
+            m_running = true;
+            for(auto& shard : m_shards)
+            {
+                shard->start();
+            }
+        }
+
+        // Call once every producer is done: every queued update is delivered before it returns.
+        void stop() {
+            if(!m_running)
+            {
+                return;
+            }
+            for(auto& shard : m_shards)
+            {
+                shard->stop();
+            }
+            m_running = false;
+        }
+
+        // Notifies the regional observers with the current averages, on the calling thread.
+        void publishRegions() {
+            for(std::size_t region = 0; region < m_regionObservers.size(); ++region)
+            {
+                if(m_regionObservers[region].empty())
+                {
+                    continue;
+                }
+                double temperature = 0.0;
+                double humidity = 0.0;
+                double pressure = 0.0;
+                std::uint32_t stations = 0;
+                for(const auto& shard : m_shards)
+                {
+                    const RegionSums& sums = shard->regionSums(region);
+                    temperature += sums.temperature.load(std::memory_order_relaxed);
+                    humidity += sums.humidity.load(std::memory_order_relaxed);
+                    pressure += sums.pressure.load(std::memory_order_relaxed);
+                    stations += sums.stations.load(std::memory_order_relaxed);
+                }
+                if(stations == 0)
+                {
+                    continue;
+                }
+                for(Observer* observer : m_regionObservers[region])
+                {
+                    observer->update(static_cast<float>(temperature / stations), static_cast<float>(humidity / stations),
+                                     static_cast<float>(pressure / stations));
+                }
+            }
+        }
+
+        std::size_t shardCount() const {
+            return m_shards.size();
+        }
+
+        std::size_t stationCount() const {
+            return m_stationCount;
+        }
+
+        std::size_t regionOf(StationId station) const {
+            return station / m_stationsPerRegion;
+        }
+
+        std::uint64_t processed() const {
+            std::uint64_t total = 0;
+            for(const auto& shard : m_shards)
+            {
+                total += shard->processed();
+            }
+            return total;
+        }
+
+    private:
+        struct Station {
+            float temperature;
+            float humidity;
+            float pressure;
+            bool reported;
+            std::vector<Observer*> observers;
+        };
+
+        /* *********************************************
+        * One shard: the stations with id % shards ==
+        * index, stored by id / shards, and the worker
+        * that drains the producer rings into them.
+        ********************************************* */
+
+        class Shard {
+
+            public:
+                Shard(const WeatherHub& hub, std::size_t index, std::size_t shards)
+                    : m_hub(hub), m_shards(shards), m_stations(), m_regions(hub.m_regionObservers.size()),
+                      m_inputs(), m_worker(), m_stopping(false), m_processed(0)
+                {
+                    m_stations.resize((hub.m_stationCount + shards - 1 - index) / shards, Station{0, 0, 0, false, {}});
+                }
+
+                Shard(const Shard&) = delete;
+                Shard& operator=(const Shard&) = delete;
+
+                UpdateRing& addInput() {
+                    m_inputs.push_back(std::make_unique<UpdateRing>());
+                    return *m_inputs.back();
+                }
+
+                Station& station(StationId id) {
+                    return m_stations[id / m_shards];
+                }
+
+                const RegionSums& regionSums(std::size_t region) const {
+                    return m_regions[region];
+                }
+
+                std::uint64_t processed() const {
+                    return m_processed.load(std::memory_order_relaxed);
+                }
+
+                void start() {
+                    m_stopping = false;
+                    m_worker = std::thread([this](){ run(); });
+                }
+
+                void stop() {
+                    m_stopping = true;
+                    m_worker.join();
+                }
+
+            private:
+                static constexpr std::size_t batchSize = 256;
+
+                void run() {
+                    std::uint64_t processed = 0;
+                    while(true)
+                    {
+                        // read the flag first: whatever was pushed before it was set is still drained below
+                        const bool stopping = m_stopping.load(std::memory_order_acquire);
+                        std::size_t drained = 0;
+                        for(auto& input : m_inputs)
+                        {
+                            drained += input->popBatch(batchSize, [this](const StationUpdate& update){ apply(update); });
+                        }
+                        processed += drained;
+                        m_processed.store(processed, std::memory_order_relaxed);
+
+                        if(drained == 0)
+                        {
+                            if(stopping)
+                            {
+                                return;
+                            }
+                            std::this_thread::yield();
+                        }
+                    }
+                }
+
+                void apply(const StationUpdate& update) {
+                    Station& target = station(update.station);
+                    RegionSums& sums = m_regions[m_hub.regionOf(update.station)];
+
+                    // only this thread writes the sums, a plain load and store is enough
+                    double temperature = sums.temperature.load(std::memory_order_relaxed) + update.temperature;
+                    double humidity = sums.humidity.load(std::memory_order_relaxed) + update.humidity;
+                    double pressure = sums.pressure.load(std::memory_order_relaxed) + update.pressure;
+                    if(target.reported)
+                    {
+                        temperature -= target.temperature;
+                        humidity -= target.humidity;
+                        pressure -= target.pressure;
+                    }
+                    else
+                    {
+                        target.reported = true;
+                        sums.stations.store(sums.stations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    }
+                    sums.temperature.store(temperature, std::memory_order_relaxed);
+                    sums.humidity.store(humidity, std::memory_order_relaxed);
+                    sums.pressure.store(pressure, std::memory_order_relaxed);
+
+                    target.temperature = update.temperature;
+                    target.humidity = update.humidity;
+                    target.pressure = update.pressure;
+                    for(Observer* observer : target.observers)
+                    {
+                        observer->update(update.temperature, update.humidity, update.pressure);
+                    }
+                }
+
+                const WeatherHub& m_hub;
+                std::size_t m_shards;
+                std::vector<Station> m_stations;
+                std::vector<RegionSums> m_regions;
+                std::vector<std::unique_ptr<UpdateRing>> m_inputs;
+                std::thread m_worker;
+                std::atomic<bool> m_stopping;
+                std::atomic<std::uint64_t> m_processed;
+        };
+
+        Shard& shardOf(StationId station) {
+            if(station >= m_stationCount)
+            {
+                throw std::out_of_range("no station " + std::to_string(station));
+            }
+            return *m_shards[station % m_shards.size()];
+        }
+
+        void requireStopped() const {
+            if(m_running)
+            {
+                throw std::logic_error("the hub must be stopped to change its configuration");
+            }
+        }
+
+        std::size_t m_stationCount;
+        std::size_t m_stationsPerRegion;
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        std::vector<std::unique_ptr<Producer>> m_producers;
+        std::vector<std::vector<Observer*>> m_regionObservers;
+        bool m_running;
+};
+
+/* *********************************************
+* The sending side of one producer thread: one ring
+* into every shard. setMeasurements spins while the
+* ring of a busy shard is full.
+********************************************* */
+
+class WeatherHub::Producer {
+
+    public:
+        explicit Producer(std::vector<UpdateRing*> rings) : m_rings(std::move(rings))
+        {
+
+        }
+
+        void setMeasurements(StationId station, float temperature, float humidity, float pressure) {
+            UpdateRing& ring = *m_rings[station % m_rings.size()];
+            const StationUpdate update{station, temperature, humidity, pressure};
+            while(!ring.push(update))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        std::vector<UpdateRing*> m_rings;
+};
+
+WeatherHub::Producer& WeatherHub::addProducer()
+{
+    requireStopped();
+    std::vector<UpdateRing*> rings;
+    for(auto& shard : m_shards)
+    {
+        rings.push_back(&shard->addInput());
+    }
+    m_producers.push_back(std::make_unique<Producer>(std::move(rings)));
+    return *m_producers.back();
+}
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        std::string m_name;
+        float m_temperature;
+        float m_humidity;
+
+    public:
+        CurrentConditionsDisplay(std::string name) : m_name(std::move(name)), m_temperature(0), m_humidity(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+        }
+
+        void display() override {
+            std::cout << m_name << ": " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+class CountingDisplay : public Observer {
+    public:
+        CountingDisplay() : m_updates(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)temperature;
+            (void)humidity;
+            (void)pressure;
+            ++m_updates;
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+
+    private:
+        std::uint64_t m_updates;
+};
+
+// more threads than this is a typo, not a machine
+static constexpr std::size_t maxThreadsLimit = 1024;
+
+// A decimal count in [1, limit], digits only: strtoul alone would take blanks and a sign.
+static bool parseCount(const char* text, std::size_t limit, std::size_t& value)
+{
+    if(!std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long parsed = std::strtoul(text, &end, 10);
+    if(*end != '\0' || errno != 0 || parsed == 0 || parsed > limit)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::cout << "chapter 2 - observer with a sharded multi-station hub" << std::endl;
+
+    // shard workers and producers together never exceed this, the first argument overrides it
+    std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    if(argc > 2 || (argc == 2 && !parseCount(argv[1], maxThreadsLimit, maxThreads)))
+    {
+        std::cerr << "usage: " << argv[0] << " [max threads]" << std::endl;
+        return 1;
+    }
+
+    {
+        WeatherHub hub(8, 2, 4);
+        CurrentConditionsDisplay station5("Station 5");
+        CurrentConditionsDisplay north("Region 0 average");
+        CurrentConditionsDisplay south("Region 1 average");
+        hub.registerObserver(5, &station5);
+        hub.registerRegionObserver(0, &north);
+        hub.registerRegionObserver(1, &south);
+
+        WeatherHub::Producer& producer = hub.addProducer();
+        hub.start();
+        producer.setMeasurements(0, 12.0, 65.0, 29.2);
+        producer.setMeasurements(1, 20.0, 55.0, 29.2);
+        producer.setMeasurements(5, 24.0, 45.0, 29.2);
+        producer.setMeasurements(6, 18.0, 50.0, 29.2);
+        hub.stop();
+
+        hub.publishRegions();
+        station5.display();
+        north.display();
+        south.display();
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 100k stations in regions of 1000, one
+    * counting observer per station. The curve is the
+    * aggregate rate against the thread budget: 2, 4, ...
+    * up to max threads, half of them shard workers and
+    * half producers, each producer sending the same
+    * number of updates.
+    ********************************************* */
+
+    const std::size_t stations = 100000;
+    const std::size_t updatesPerProducer = 2000000;
+
+    std::vector<std::size_t> budgets;
+    for(std::size_t budget = 2; budget < maxThreads; budget *= 2)
+    {
+        budgets.push_back(budget);
+    }
+    budgets.push_back(std::max<std::size_t>(2, maxThreads));
+
+    for(std::size_t budget : budgets)
+    {
+        const std::size_t shards = budget / 2;
+        const std::size_t producerCount = budget - shards;
+
+        WeatherHub hub(stations, shards, 1000);
+        std::vector<CountingDisplay> displays(stations);
+        for(StationId station = 0; station < stations; ++station)
+        {
+            hub.registerObserver(station, &displays[station]);
+        }
+        CountingDisplay regional;
+        hub.registerRegionObserver(0, &regional);
+
+        std::vector<WeatherHub::Producer*> producers;
+        for(std::size_t p = 0; p < producerCount; ++p)
+        {
+            producers.push_back(&hub.addProducer());
+        }
+
+        hub.start();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for(std::size_t p = 0; p < producerCount; ++p)
+        {
+            threads.emplace_back([&producer = *producers[p], p, stations, updatesPerProducer](){
+                std::minstd_rand random(static_cast<unsigned>(p + 1));
+                for(std::size_t i = 0; i < updatesPerProducer; ++i)
+                {
+                    const StationId station = static_cast<StationId>(random() % stations);
+                    producer.setMeasurements(station, 20.0f + static_cast<float>(i % 10), 50.0f, 1013.0f);
+                }
+            });
+        }
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+        hub.stop();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        hub.publishRegions();
+
+        std::uint64_t delivered = 0;
+        for(const auto& display : displays)
+        {
+            delivered += display.updates();
+        }
+
+        std::cout << budget << " threads (" << shards << " shards + " << producerCount << " producers): "
+                  << hub.processed() / seconds / 1e6 << "M updates/s, "
+                  << delivered << " observer calls, " << regional.updates() << " regional update" << std::endl;
+    }
+}
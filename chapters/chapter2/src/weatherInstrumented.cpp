@@ -0,0 +1,541 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with instrumentation in notifyObservers:
+* per observer it counts the calls, adds up the time
+* spent in update() and keeps a latency histogram, so
+* when a notification gets slow the culprit shows up
+* in the numbers instead of in a profiler session.
+*
+* Timing reads the time stamp counter (rdtsc), which
+* costs a few nanoseconds; one reading ends a call and
+* starts the next. Only about every n-th notification
+* is timed, calls are always counted, and times are
+* converted to nanoseconds only on export. The gap
+* between timed notifications is drawn at random around
+* n, so an observer that stalls periodically cannot
+* hide between the samples.
+*
+* Statistics are written by the notifying thread
+* alone, as relaxed atomics, so they can be exported as
+* JSON from any thread while notifications go on.
+*
+* The program ends with the overhead per sampling rate
+* and a hunt for a display that stalls now and then.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WEATHER_INSTRUMENTED_X86 1
+#endif
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+/* *********************************************
+* Ticks: the time stamp counter where there is one,
+* nanoseconds of the steady clock elsewhere. The ratio
+* to nanoseconds is measured once against the steady
+* clock.
+********************************************* */
+
+static std::uint64_t readTicks()
+{
+#ifdef WEATHER_INSTRUMENTED_X86
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static double nanosecondsPerTick()
+{
+#ifdef WEATHER_INSTRUMENTED_X86
+    static const double ratio = [](){
+        const auto clockStart = std::chrono::steady_clock::now();
+        const std::uint64_t ticksStart = readTicks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const std::uint64_t ticks = readTicks() - ticksStart;
+        const double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - clockStart).count();
+        return ticks == 0 ? 1.0 : nanoseconds / static_cast<double>(ticks);
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+// Only the notifying thread writes, so a load and a store do instead of a locked add.
+static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/* *********************************************
+* Histogram of ticks in the HDR manner: exact below
+* 16, above that every power of two is split into 16
+* buckets, so a percentile is off by at most 1/16.
+********************************************* */
+
+class TickHistogram {
+
+    public:
+        TickHistogram() : m_buckets(), m_max(0)
+        {
+            for(auto& bucket : m_buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        TickHistogram(const TickHistogram&) = delete;
+        TickHistogram& operator=(const TickHistogram&) = delete;
+
+        void record(std::uint64_t ticks) {
+            bump(m_buckets[bucketOf(ticks)], 1);
+            if(ticks > m_max.load(std::memory_order_relaxed))
+            {
+                m_max.store(ticks, std::memory_order_relaxed);
+            }
+        }
+
+        std::uint64_t max() const {
+            return m_max.load(std::memory_order_relaxed);
+        }
+
+        // Upper bound of the bucket that holds the given quantile of `count` recorded values.
+        std::uint64_t percentile(double quantile, std::uint64_t count) const {
+            if(count == 0)
+            {
+                return 0;
+            }
+            const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(count))));
+            std::uint64_t seen = 0;
+            for(std::size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+            {
+                seen += m_buckets[bucket].load(std::memory_order_relaxed);
+                if(seen >= rank)
+                {
+                    return std::min(upperBound(bucket), max());
+                }
+            }
+            return max();
+        }
+
+    private:
+        static constexpr unsigned subBits = 4;
+        static constexpr std::size_t subBuckets = 1u << subBits;
+
+        static std::size_t bucketOf(std::uint64_t value) {
+            if(value < subBuckets)
+            {
+                return static_cast<std::size_t>(value);
+            }
+            const unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(value));
+            const std::size_t sub = static_cast<std::size_t>((value >> (exponent - subBits)) & (subBuckets - 1));
+            return (exponent - subBits + 1) * subBuckets + sub;
+        }
+
+        static std::uint64_t upperBound(std::size_t bucket) {
+            if(bucket < subBuckets)
+            {
+                return bucket;
+            }
+            const unsigned exponent = static_cast<unsigned>(bucket / subBuckets) + subBits - 1;
+            const std::uint64_t width = std::uint64_t(1) << (exponent - subBits);
+            return (std::uint64_t(1) << exponent) + (bucket % subBuckets + 1) * width - 1;
+        }
+
+        std::array<std::atomic<std::uint64_t>, (64 - subBits + 1) * subBuckets> m_buckets;
+        std::atomic<std::uint64_t> m_max;
+};
+
+struct ObserverCounters {
+    ObserverCounters() : calls(0), sampledCalls(0), sampledTicks(0), histogram()
+    {
+
+    }
+
+    std::atomic<std::uint64_t> calls;
+    std::atomic<std::uint64_t> sampledCalls;
+    std::atomic<std::uint64_t> sampledTicks;
+    TickHistogram histogram;
+};
+
+// What the export reports for one observer; times in nanoseconds.
+struct ObserverStatistics {
+    std::string name;
+    std::uint64_t calls;
+    std::uint64_t sampledCalls;
+    double meanNanoseconds;
+    // mean times calls, what all calls probably took
+    double estimatedTotalNanoseconds;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escaped;
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+class WeatherData : public Subject {
+    private:
+        struct Entry {
+            Observer* observer;
+            std::string name;
+            std::unique_ptr<ObserverCounters> counters;
+        };
+
+        std::vector<Entry> m_observers;
+        std::uint32_t m_sampleEvery;
+        std::uint32_t m_untilSample;
+        std::uint64_t m_random;
+        std::atomic<std::uint64_t> m_notifications;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        // sampleEvery: time one notification in n on average, 0 turns the instrumentation off
+        explicit WeatherData(std::uint32_t sampleEvery = 0)
+            : m_observers(), m_sampleEvery(sampleEvery), m_untilSample(0), m_random(0x9e3779b97f4a7c15ull), m_notifications(0), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        WeatherData(const WeatherData&) = delete;
+        WeatherData& operator=(const WeatherData&) = delete;
+
+        void registerObserver(Observer* o) override {
+            registerObserver(o, "observer " + std::to_string(m_observers.size() + 1));
+        }
+
+        void registerObserver(Observer* o, const std::string& name) {
+            m_observers.push_back(Entry{o, name, std::make_unique<ObserverCounters>()});
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.erase(std::remove_if(m_observers.begin(), m_observers.end(),
+                                             [o](const Entry& entry){ return entry.observer == o; }), m_observers.end());
+        }
+
+        void notifyObservers() override {
+            if(m_sampleEvery == 0)
+            {
+                for(auto& entry : m_observers)
+                {
+                    entry.observer->update(m_temperature, m_humidity, m_pressure);
+                }
+                return;
+            }
+
+            bump(m_notifications, 1);
+            if(m_untilSample != 0)
+            {
+                --m_untilSample;
+                for(auto& entry : m_observers)
+                {
+                    bump(entry.counters->calls, 1);
+                    entry.observer->update(m_temperature, m_humidity, m_pressure);
+                }
+                return;
+            }
+
+            m_untilSample = nextGap() - 1;
+            std::uint64_t before = readTicks();
+            for(auto& entry : m_observers)
+            {
+                entry.observer->update(m_temperature, m_humidity, m_pressure);
+                const std::uint64_t after = readTicks();
+                ObserverCounters& counters = *entry.counters;
+                bump(counters.calls, 1);
+                bump(counters.sampledCalls, 1);
+                bump(counters.sampledTicks, after - before);
+                counters.histogram.record(after - before);
+                before = after;
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+        std::vector<ObserverStatistics> statistics() const {
+            const double scale = nanosecondsPerTick();
+            std::vector<ObserverStatistics> result;
+            result.reserve(m_observers.size());
+            for(const auto& entry : m_observers)
+            {
+                const ObserverCounters& counters = *entry.counters;
+                const std::uint64_t calls = counters.calls.load(std::memory_order_relaxed);
+                const std::uint64_t sampled = counters.sampledCalls.load(std::memory_order_relaxed);
+                const double mean = sampled == 0 ? 0.0
+                    : static_cast<double>(counters.sampledTicks.load(std::memory_order_relaxed)) * scale / static_cast<double>(sampled);
+                result.push_back(ObserverStatistics{entry.name, calls, sampled, mean, mean * static_cast<double>(calls),
+                                                    static_cast<double>(counters.histogram.percentile(0.50, sampled)) * scale,
+                                                    static_cast<double>(counters.histogram.percentile(0.99, sampled)) * scale,
+                                                    static_cast<double>(counters.histogram.percentile(0.999, sampled)) * scale,
+                                                    static_cast<double>(counters.histogram.max()) * scale});
+            }
+            return result;
+        }
+
+        void exportJson(std::ostream& out) const {
+            std::ostringstream json;
+            json << std::fixed << std::setprecision(1);
+            json << "{\"notifications\": " << m_notifications.load(std::memory_order_relaxed)
+                 << ", \"sampleEvery\": " << m_sampleEvery << ", \"observers\": [";
+            const std::vector<ObserverStatistics> observers = statistics();
+            for(std::size_t i = 0; i < observers.size(); ++i)
+            {
+                const ObserverStatistics& s = observers[i];
+                json << (i == 0 ? "\n" : ",\n")
+                     << "  {\"name\": " << jsonString(s.name) << ", \"calls\": " << s.calls << ", \"sampledCalls\": " << s.sampledCalls
+                     << ", \"meanNs\": " << s.meanNanoseconds << ", \"estimatedTotalNs\": " << s.estimatedTotalNanoseconds
+                     << ", \"p50Ns\": " << s.p50 << ", \"p99Ns\": " << s.p99 << ", \"p999Ns\": " << s.p999 << ", \"maxNs\": " << s.max << "}";
+            }
+            json << (observers.empty() ? "]}" : "\n]}");
+            out << json.str() << std::endl;
+        }
+
+    private:
+        // Uniform in [1, 2n - 1], so n on average; xorshift is plenty for this.
+        std::uint32_t nextGap() {
+            if(m_sampleEvery <= 1)
+            {
+                return 1;
+            }
+            m_random ^= m_random << 13;
+            m_random ^= m_random >> 7;
+            m_random ^= m_random << 17;
+            return 1 + static_cast<std::uint32_t>(m_random % (2 * static_cast<std::uint64_t>(m_sampleEvery) - 1));
+        }
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        WeatherData* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(WeatherData* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this, "current conditions");
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// Smoothed values and a dew point, about what a small display computes.
+class DewPointDisplay : public Observer {
+    public:
+        DewPointDisplay() : m_temperature(0.0f), m_humidity(0.0f), m_dewPoint(0.0f)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)pressure;
+            m_temperature += 0.1f * (temperature - m_temperature);
+            m_humidity += 0.1f * (humidity - m_humidity);
+            const float gamma = std::log(std::max(m_humidity, 1.0f) / 100.0f) + 17.62f * m_temperature / (243.12f + m_temperature);
+            m_dewPoint = 243.12f * gamma / (17.62f - gamma);
+        }
+
+    private:
+        float m_temperature;
+        float m_humidity;
+        float m_dewPoint;
+};
+
+// Usually quick, but every `period`-th update it stalls for `stall`, like a display waiting on a lock.
+class StallingDisplay : public Observer {
+    public:
+        StallingDisplay(std::uint64_t period, std::chrono::microseconds stall) : m_period(period), m_stall(stall), m_updates(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)temperature;
+            (void)humidity;
+            (void)pressure;
+            if(++m_updates % m_period == 0)
+            {
+                const auto until = std::chrono::steady_clock::now() + m_stall;
+                while(std::chrono::steady_clock::now() < until)
+                {
+                }
+            }
+        }
+
+    private:
+        std::uint64_t m_period;
+        std::chrono::microseconds m_stall;
+        std::uint64_t m_updates;
+};
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with per-observer instrumentation" << std::endl;
+
+    {
+        WeatherData weatherData(1);
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        DewPointDisplay dewPointDisplay;
+        weatherData.registerObserver(&dewPointDisplay, "dew point");
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        weatherData.exportJson(std::cout);
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Overhead: 100 dew point displays, 200000
+    * notifications, without instrumentation and with
+    * every 1st, 16th and 256th notification timed.
+    ********************************************* */
+
+    const std::size_t displays = 100;
+    const int notifications = 200000;
+    std::cout << "ticks: " << nanosecondsPerTick() << " ns each" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    double baseline = 0.0;
+    for(std::uint32_t sampleEvery : {0u, 1u, 16u, 256u})
+    {
+        std::vector<DewPointDisplay> observers(displays);
+        WeatherData weatherData(sampleEvery);
+        for(auto& observer : observers)
+        {
+            weatherData.registerObserver(&observer);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < notifications; ++i)
+        {
+            weatherData.setMeasurements(static_cast<float>(i % 30), 50.0f, 29.2f);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double perCall = std::chrono::duration<double, std::nano>(stop - start).count() / (static_cast<double>(notifications) * displays);
+        if(sampleEvery == 0)
+        {
+            baseline = perCall;
+        }
+        std::cout << (sampleEvery == 0 ? std::string("off") : "every " + std::to_string(sampleEvery)) << ": "
+                  << perCall << " ns per update() call, " << std::showpos << perCall - baseline << std::noshowpos
+                  << " ns" << std::endl;
+    }
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Spike hunt: 9 displays, one of which stalls for
+    * 200 us on every 1000th update. 100000 notifications,
+    * one in 16 timed; the export points at it.
+    ********************************************* */
+
+    {
+        std::vector<DewPointDisplay> observers(8);
+        StallingDisplay stalling(1000, std::chrono::microseconds(200));
+        WeatherData weatherData(16);
+        for(std::size_t i = 0; i < observers.size(); ++i)
+        {
+            weatherData.registerObserver(&observers[i], "dew point " + std::to_string(i + 1));
+            if(i == 4)
+            {
+                weatherData.registerObserver(&stalling, "radar overlay");
+            }
+        }
+
+        for(int i = 0; i < 100000; ++i)
+        {
+            weatherData.setMeasurements(static_cast<float>(i % 30), 50.0f, 29.2f);
+        }
+
+        const std::vector<ObserverStatistics> statistics = weatherData.statistics();
+        const auto slowest = std::max_element(statistics.begin(), statistics.end(),
+            [](const ObserverStatistics& left, const ObserverStatistics& right){ return left.max < right.max; });
+        std::cout << "slowest observer: " << slowest->name << ", max " << slowest->max / 1e3 << " us, p999 "
+                  << slowest->p999 / 1e3 << " us over " << slowest->sampledCalls << " timed calls" << std::endl;
+        weatherData.exportJson(std::cout);
+    }
+}
@@ -0,0 +1,666 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with priority classes. Every observer is
+* registered with a class and, optionally, a latency
+* budget; notifyObservers walks the classes from
+* critical to low, and inside a class the tighter
+* budgets go first. A frost alarm registered last is
+* no longer stuck behind every dashboard.
+*
+* The critical class can also get a dedicated thread:
+* notifyObservers then only drops the measurement in
+* its mailbox and goes on with the other classes. The
+* mailbox is a ring of the last 64 measurements. The
+* publisher never waits for the critical thread, so
+* when that thread falls further behind the oldest
+* measurement is dropped and counted as skipped: the
+* critical observers may miss readings under overload,
+* but never see one older than 64 publications and
+* never slow the publisher down.
+*
+* The time from setMeasurements to the entry of each
+* update() is recorded in one log-linear histogram per
+* class and exported with p50/p99/p999 and the number
+* of skipped measurements on demand; calls over an
+* observer's budget are counted.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+enum class Priority { Critical, High, Normal, Low };
+
+static constexpr std::size_t priorityCount = 4;
+
+static const char* priorityName(Priority priority)
+{
+    switch(priority)
+    {
+        case Priority::Critical:
+            return "critical";
+        case Priority::High:
+            return "high";
+        case Priority::Normal:
+            return "normal";
+        case Priority::Low:
+            break;
+    }
+    return "low";
+}
+
+/* *********************************************
+* Latency histogram in nanoseconds. Values below 16
+* have a bucket each; above, every power of two is
+* split into 16 buckets, so a percentile is off by at
+* most 1/16. Counters are atomics so that export can
+* run while notifications go on.
+********************************************* */
+
+class LatencyHistogram {
+
+    public:
+        LatencyHistogram() : m_buckets(), m_count(0), m_max(0)
+        {
+            for(auto& bucket : m_buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        LatencyHistogram(const LatencyHistogram&) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+        // Only one thread records into a histogram.
+        void record(std::uint64_t nanoseconds) {
+            m_buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            if(nanoseconds > m_max.load(std::memory_order_relaxed))
+            {
+                m_max.store(nanoseconds, std::memory_order_relaxed);
+            }
+        }
+
+        std::uint64_t count() const {
+            return m_count.load(std::memory_order_relaxed);
+        }
+
+        std::uint64_t max() const {
+            return m_max.load(std::memory_order_relaxed);
+        }
+
+        // Upper bound of the bucket that holds the given quantile.
+        std::uint64_t percentile(double quantile) const {
+            const std::uint64_t total = count();
+            if(total == 0)
+            {
+                return 0;
+            }
+            const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(quantile * static_cast<double>(total) + 0.5));
+            std::uint64_t seen = 0;
+            for(std::size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+            {
+                seen += m_buckets[bucket].load(std::memory_order_relaxed);
+                if(seen >= rank)
+                {
+                    return std::min(upperBound(bucket), max());
+                }
+            }
+            return max();
+        }
+
+    private:
+        static constexpr unsigned subBits = 4;
+        static constexpr std::size_t subBuckets = 1u << subBits;
+
+        static std::size_t bucketOf(std::uint64_t value) {
+            if(value < subBuckets)
+            {
+                return static_cast<std::size_t>(value);
+            }
+            const unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(value));
+            const std::size_t sub = static_cast<std::size_t>((value >> (exponent - subBits)) & (subBuckets - 1));
+            return (exponent - subBits + 1) * subBuckets + sub;
+        }
+
+        static std::uint64_t upperBound(std::size_t bucket) {
+            if(bucket < subBuckets)
+            {
+                return bucket;
+            }
+            const unsigned exponent = static_cast<unsigned>(bucket / subBuckets) + subBits - 1;
+            const std::uint64_t sub = bucket % subBuckets;
+            const std::uint64_t width = std::uint64_t(1) << (exponent - subBits);
+            return (std::uint64_t(1) << exponent) + (sub + 1) * width - 1;
+        }
+
+        std::array<std::atomic<std::uint64_t>, (64 - subBits + 1) * subBuckets> m_buckets;
+        std::atomic<std::uint64_t> m_count;
+        std::atomic<std::uint64_t> m_max;
+};
+
+// The observer list this thread is walking in notify() right now.
+static thread_local const void* notifyingList = nullptr;
+
+class WeatherData : public Subject {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Registration {
+            Observer* observer;
+            Priority priority;
+            std::chrono::nanoseconds budget;
+            std::uint64_t order;
+            std::uint64_t overBudget;
+        };
+
+        struct Measurement {
+            float temperature;
+            float humidity;
+            float pressure;
+            Clock::time_point published;
+        };
+
+        std::vector<Registration> m_observers;
+        std::uint64_t m_registrations;
+        std::array<LatencyHistogram, priorityCount> m_histograms;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+        // dedicated thread for the critical class, if enabled
+        bool m_dedicated;
+        std::mutex m_criticalObserversMutex;
+        std::vector<Registration> m_criticalObservers;
+        static constexpr std::size_t mailboxCapacity = 64;
+        std::mutex m_mailboxMutex;
+        std::condition_variable m_mailboxChanged;
+        std::array<Measurement, mailboxCapacity> m_mailbox;
+        std::size_t m_mailboxFirst;
+        std::size_t m_mailboxSize;
+        std::array<std::atomic<std::uint64_t>, priorityCount> m_skipped;
+        bool m_stop;
+        std::thread m_criticalThread;
+
+    public:
+        explicit WeatherData(bool dedicatedCriticalThread = false)
+            : m_observers(), m_registrations(0), m_histograms(), m_temperature(0), m_humidity(0), m_pressure(0),
+              m_dedicated(dedicatedCriticalThread), m_criticalObserversMutex(), m_criticalObservers(),
+              m_mailboxMutex(), m_mailboxChanged(), m_mailbox{}, m_mailboxFirst(0), m_mailboxSize(0), m_skipped(),
+              m_stop(false), m_criticalThread()
+        {
+            for(auto& skipped : m_skipped)
+            {
+                skipped.store(0, std::memory_order_relaxed);
+            }
+            if(m_dedicated)
+            {
+                m_criticalThread = std::thread([this](){ criticalLoop(); });
+            }
+        }
+
+        ~WeatherData() override {
+            if(m_dedicated)
+            {
+                {
+                    const std::lock_guard<std::mutex> lock(m_mailboxMutex);
+                    m_stop = true;
+                }
+                m_mailboxChanged.notify_one();
+                m_criticalThread.join();
+            }
+        }
+
+        WeatherData(const WeatherData&) = delete;
+        WeatherData& operator=(const WeatherData&) = delete;
+
+        void registerObserver(Observer* o) override {
+            registerObserver(o, Priority::Normal);
+        }
+
+        // A zero budget means none. Within a class, observers with a budget come first, tightest first.
+        void registerObserver(Observer* o, Priority priority, std::chrono::nanoseconds budget = std::chrono::nanoseconds(0)) {
+            const Registration registration{o, priority, budget, m_registrations++, 0};
+            if(m_dedicated && priority == Priority::Critical)
+            {
+                const std::lock_guard<std::mutex> lock(m_criticalObserversMutex);
+                insertSorted(m_criticalObservers, registration);
+            }
+            else
+            {
+                insertSorted(m_observers, registration);
+            }
+        }
+
+        // May be called from inside an update(): the list being walked is pruned when the walk ends.
+        // On the critical thread only critical observers can be removed, the others belong to the publisher.
+        void removeObserver(Observer* o) override {
+            if(notifyingList == &m_criticalObservers)
+            {
+                // the critical thread already holds m_criticalObserversMutex
+                removeFrom(m_criticalObservers, o);
+                return;
+            }
+            removeFrom(m_observers, o);
+            const std::lock_guard<std::mutex> lock(m_criticalObserversMutex);
+            removeFrom(m_criticalObservers, o);
+        }
+
+        void notifyObservers() override {
+            const Measurement measurement{m_temperature, m_humidity, m_pressure, Clock::now()};
+            if(m_dedicated)
+            {
+                post(measurement);
+            }
+            notify(m_observers, measurement);
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+        // Waits until the critical thread has delivered every measurement in its mailbox.
+        void flush() {
+            if(!m_dedicated)
+            {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(m_mailboxMutex);
+            m_mailboxChanged.wait(lock, [this](){ return m_mailboxSize == 0; });
+            // the critical thread may still be inside dispatch, wait until it lets go of the observers
+            const std::lock_guard<std::mutex> observersLock(m_criticalObserversMutex);
+        }
+
+        const LatencyHistogram& histogram(Priority priority) const {
+            return m_histograms[static_cast<std::size_t>(priority)];
+        }
+
+        // Measurements the class never saw because its mailbox overflowed.
+        std::uint64_t skipped(Priority priority) const {
+            return m_skipped[static_cast<std::size_t>(priority)].load(std::memory_order_relaxed);
+        }
+
+        std::uint64_t overBudget(Observer* o) {
+            for(const auto& registration : m_observers)
+            {
+                if(registration.observer == o)
+                {
+                    return registration.overBudget;
+                }
+            }
+            const std::lock_guard<std::mutex> lock(m_criticalObserversMutex);
+            for(const auto& registration : m_criticalObservers)
+            {
+                if(registration.observer == o)
+                {
+                    return registration.overBudget;
+                }
+            }
+            return 0;
+        }
+
+        void exportHistograms(std::ostream& out) const {
+            out << std::setw(10) << "class" << std::setw(10) << "calls" << std::setw(12) << "p50 us"
+                << std::setw(12) << "p99 us" << std::setw(12) << "p999 us" << std::setw(12) << "max us"
+                << std::setw(10) << "skipped" << std::endl;
+            for(std::size_t c = 0; c < priorityCount; ++c)
+            {
+                const LatencyHistogram& histogram = m_histograms[c];
+                const std::uint64_t skipped = m_skipped[c].load(std::memory_order_relaxed);
+                if(histogram.count() == 0 && skipped == 0)
+                {
+                    continue;
+                }
+                out << std::setw(10) << priorityName(static_cast<Priority>(c)) << std::setw(10) << histogram.count()
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(12) << histogram.percentile(0.50) / 1e3 << std::setw(12) << histogram.percentile(0.99) / 1e3
+                    << std::setw(12) << histogram.percentile(0.999) / 1e3 << std::setw(12) << histogram.max() / 1e3
+                    << std::setw(10) << skipped << std::endl;
+            }
+        }
+
+    private:
+        static bool before(const Registration& left, const Registration& right) {
+            if(left.priority != right.priority)
+            {
+                return left.priority < right.priority;
+            }
+            const auto none = std::chrono::nanoseconds::max();
+            const auto leftBudget = left.budget.count() > 0 ? left.budget : none;
+            const auto rightBudget = right.budget.count() > 0 ? right.budget : none;
+            if(leftBudget != rightBudget)
+            {
+                return leftBudget < rightBudget;
+            }
+            return left.order < right.order;
+        }
+
+        static void insertSorted(std::vector<Registration>& observers, const Registration& registration) {
+            observers.insert(std::upper_bound(observers.begin(), observers.end(), registration, before), registration);
+        }
+
+        static void removeFrom(std::vector<Registration>& observers, Observer* o) {
+            auto matches = [o](const Registration& registration){ return registration.observer == o; };
+            if(notifyingList == &observers)
+            {
+                // erasing would move the registrations under notify(), only clear them
+                for(auto& registration : observers)
+                {
+                    if(matches(registration))
+                    {
+                        registration.observer = nullptr;
+                    }
+                }
+                return;
+            }
+            observers.erase(std::remove_if(observers.begin(), observers.end(), matches), observers.end());
+        }
+
+        void notify(std::vector<Registration>& observers, const Measurement& measurement) {
+            notifyingList = &observers;
+            for(auto& registration : observers)
+            {
+                if(registration.observer == nullptr)
+                {
+                    continue;
+                }
+                const auto latency = Clock::now() - measurement.published;
+                m_histograms[static_cast<std::size_t>(registration.priority)].record(
+                    static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+                if(registration.budget.count() > 0 && latency > registration.budget)
+                {
+                    ++registration.overBudget;
+                }
+                registration.observer->update(measurement.temperature, measurement.humidity, measurement.pressure);
+            }
+            notifyingList = nullptr;
+            removeFrom(observers, nullptr);
+        }
+
+        // Appends to the critical mailbox; a full mailbox drops its oldest measurement.
+        void post(const Measurement& measurement) {
+            {
+                const std::lock_guard<std::mutex> lock(m_mailboxMutex);
+                if(m_mailboxSize == mailboxCapacity)
+                {
+                    m_mailboxFirst = (m_mailboxFirst + 1) % mailboxCapacity;
+                    --m_mailboxSize;
+                    m_skipped[static_cast<std::size_t>(Priority::Critical)].fetch_add(1, std::memory_order_relaxed);
+                }
+                m_mailbox[(m_mailboxFirst + m_mailboxSize) % mailboxCapacity] = measurement;
+                ++m_mailboxSize;
+            }
+            m_mailboxChanged.notify_one();
+        }
+
+        void criticalLoop() {
+            while(true)
+            {
+                Measurement measurement{0, 0, 0, Clock::time_point()};
+                std::unique_lock<std::mutex> observersLock(m_criticalObserversMutex, std::defer_lock);
+                {
+                    std::unique_lock<std::mutex> lock(m_mailboxMutex);
+                    m_mailboxChanged.wait(lock, [this](){ return m_stop || m_mailboxSize > 0; });
+                    if(m_mailboxSize == 0)
+                    {
+                        return;
+                    }
+                    measurement = m_mailbox[m_mailboxFirst];
+                    // taken before the measurement leaves the mailbox, so flush() cannot slip in between
+                    observersLock.lock();
+                    m_mailboxFirst = (m_mailboxFirst + 1) % mailboxCapacity;
+                    --m_mailboxSize;
+                }
+                m_mailboxChanged.notify_all();
+                notify(m_criticalObservers, measurement);
+            }
+        }
+};
+
+// Raises the alarm when the temperature drops to freezing.
+class FrostAlarm : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        std::uint64_t m_alarms;
+
+    public:
+        FrostAlarm() : m_temperature(0), m_alarms(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            m_temperature = temperature;
+            if(temperature <= 0.0f)
+            {
+                ++m_alarms;
+            }
+        }
+
+        void display() override {
+            std::cout << "Frost alarm: " << m_alarms << " alarms, last " << m_temperature << "°C" << std::endl;
+        }
+
+        std::uint64_t alarms() const {
+            return m_alarms;
+        }
+};
+
+// Raises the alarm at the first frost and unsubscribes, from inside update().
+class FirstFrostAlarm : public Observer {
+    private:
+        std::uint64_t m_updates;
+        float m_temperature;
+        WeatherData* m_weatherData;
+
+    public:
+        FirstFrostAlarm(WeatherData* weatherData) : m_updates(0), m_temperature(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this, Priority::Critical);
+        }
+
+        FirstFrostAlarm(const FirstFrostAlarm&) = default;
+        FirstFrostAlarm& operator=(const FirstFrostAlarm&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            ++m_updates;
+            if(temperature <= 0.0f)
+            {
+                m_temperature = temperature;
+                m_weatherData->removeObserver(this);
+            }
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+
+        float temperature() const {
+            return m_temperature;
+        }
+};
+
+// A dashboard that needs a moment to redraw.
+class DashboardDisplay : public Observer {
+    public:
+        DashboardDisplay() : m_chart(0.0f)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            float chart = m_chart;
+            for(int i = 0; i < 100; ++i)
+            {
+                chart = chart * 0.99f + (temperature + humidity * 0.01f + pressure * 0.001f) * 0.01f;
+            }
+            m_chart = chart;
+        }
+
+    private:
+        float m_chart;
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with priority classes and latency budgets" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        FrostAlarm frostAlarm;
+        weatherData.registerObserver(&frostAlarm, Priority::Critical, std::chrono::microseconds(5));
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(-2.0, 85.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        frostAlarm.display();
+        std::cout << std::endl;
+    }
+
+    // an alarm that leaves after the first frost, called on the publishing thread and on the critical thread
+    for(bool dedicated : {false, true})
+    {
+        WeatherData weatherData(dedicated);
+        FirstFrostAlarm firstFrost(&weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(-2.0, 85.0, 29.2);
+        weatherData.setMeasurements(-4.0, 90.0, 29.2);
+        weatherData.flush();
+        std::cout << "First frost (" << (dedicated ? "critical thread" : "publishing thread") << "): " << firstFrost.temperature()
+                  << "°C, " << firstFrost.updates() << " update(s) before it unsubscribed" << std::endl;
+    }
+    std::cout << std::endl;
+
+    /* *********************************************
+    * Benchmark: 1000 dashboards registered before one
+    * frost alarm with a 5 us budget, 10000 measurements.
+    * First everybody in one class without budgets, the
+    * order of weather.cpp: the alarm is called last, so
+    * its latency is that of the whole notification and
+    * is timed around setMeasurements. Then the alarm as
+    * critical, then critical on its own thread.
+    ********************************************* */
+
+    const std::size_t dashboards = 1000;
+    const int measurements = 10000;
+    const std::chrono::nanoseconds budget = std::chrono::microseconds(5);
+    std::cout << std::fixed << std::setprecision(2);
+
+    for(int mode = 0; mode < 3; ++mode)
+    {
+        const bool prioritized = mode > 0;
+        const bool dedicated = mode == 2;
+        std::vector<DashboardDisplay> displays(dashboards);
+        FrostAlarm frostAlarm;
+        LatencyHistogram notifications;
+        std::uint64_t overBudget = 0;
+
+        WeatherData weatherData(dedicated);
+        for(auto& display : displays)
+        {
+            weatherData.registerObserver(&display, prioritized ? Priority::Low : Priority::Normal);
+        }
+        if(prioritized)
+        {
+            weatherData.registerObserver(&frostAlarm, Priority::Critical, budget);
+        }
+        else
+        {
+            weatherData.registerObserver(&frostAlarm);
+        }
+
+        for(int i = 0; i < measurements; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            weatherData.setMeasurements(static_cast<float>(i % 20) - 5.0f, 80.0f, 29.2f);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            notifications.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+            if(!prioritized && elapsed > budget)
+            {
+                ++overBudget;
+            }
+        }
+        weatherData.flush();
+        if(prioritized)
+        {
+            overBudget = weatherData.overBudget(&frostAlarm);
+        }
+
+        std::cout << (mode == 0 ? "registration order" : mode == 1 ? "priority order" : "priority order, dedicated critical thread")
+                  << ": frost alarm over budget " << overBudget << " times, " << frostAlarm.alarms() << " alarms, "
+                  << weatherData.skipped(Priority::Critical) << " measurements skipped, whole notification p50 "
+                  << notifications.percentile(0.50) / 1e3 << " us, p99 " << notifications.percentile(0.99) / 1e3 << " us" << std::endl;
+        weatherData.exportHistograms(std::cout);
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,673 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern fed from recorded traffic. Measurements
+* are stored as fixed size binary records with a
+* timestamp; the file is mapped with mmap and the
+* records are handed to setMeasurements straight from
+* the mapping, either as fast as possible or spaced
+* out like they were recorded.
+*
+* Files of many gigabytes are fine: the mapping is
+* read ahead a window at a time with madvise, and the
+* pages behind the replay are released again.
+*
+* Usage:
+*   chapter2_7                                  demo and benchmark
+*   chapter2_7 convert <in.csv> <out.replay>    CSV to binary
+*   chapter2_7 replay <file.replay> [speed]     speed 1 = wall clock, 0 = max
+*
+* The CSV columns are timestamp in nanoseconds,
+* temperature, humidity and pressure; a first line
+* that does not start with a digit is skipped.
+********************************************* */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <vector>
+#include <list>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+};
+
+/* *********************************************
+* Replay file layout, version 1. Integers and floats
+* are in the byte order of the writing host, checked
+* with the byte order mark.
+*
+*   header (64 bytes)
+*   MeasurementRecord[count] at recordsOffset
+*
+* Timestamps are nanoseconds and must not decrease.
+********************************************* */
+
+struct MeasurementRecord {
+    std::int64_t timestamp;
+    float temperature;
+    float humidity;
+    float pressure;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(MeasurementRecord) == 24, "measurement record layout changed");
+
+struct ReplayHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t recordSize;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::uint64_t recordsOffset;
+    std::uint8_t padding[24];
+};
+
+static_assert(sizeof(ReplayHeader) == 64, "replay header layout changed");
+
+static constexpr char replayMagic[8] = {'W', 'X', 'R', 'E', 'P', 'L', 'A', 'Y'};
+static constexpr std::uint32_t replayVersion = 1;
+static constexpr std::uint32_t replayByteOrder = 0x01020304;
+
+/* *********************************************
+* Streams records into a replay file. The record
+* count is patched into the header by close().
+********************************************* */
+
+class ReplayWriter {
+
+    public:
+        explicit ReplayWriter(const std::string& path) : m_path(path), m_out(path, std::ios::binary | std::ios::trunc),
+            m_buffer(), m_count(0)
+        {
+            if(!m_out)
+            {
+                throw std::runtime_error("could not create " + path);
+            }
+            m_buffer.reserve(bufferRecords);
+            const ReplayHeader header = makeHeader();
+            m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+        ~ReplayWriter() {
+            if(m_out.is_open())
+            {
+                try
+                {
+                    close();
+                }
+                catch(const std::exception& error)
+                {
+                    std::cerr << error.what() << std::endl;
+                }
+            }
+        }
+
+        ReplayWriter(const ReplayWriter&) = delete;
+        ReplayWriter& operator=(const ReplayWriter&) = delete;
+
+        void add(const MeasurementRecord& record) {
+            m_buffer.push_back(record);
+            ++m_count;
+            if(m_buffer.size() == bufferRecords)
+            {
+                flush();
+            }
+        }
+
+        std::uint64_t close() {
+            flush();
+            const ReplayHeader header = makeHeader();
+            m_out.seekp(0);
+            m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            m_out.close();
+            if(!m_out)
+            {
+                throw std::runtime_error("could not write " + m_path);
+            }
+            return m_count;
+        }
+
+    private:
+        static constexpr std::size_t bufferRecords = 64 * 1024;
+
+        ReplayHeader makeHeader() const {
+            ReplayHeader header{};
+            std::memcpy(header.magic, replayMagic, sizeof(header.magic));
+            header.version = replayVersion;
+            header.byteOrder = replayByteOrder;
+            header.recordSize = sizeof(MeasurementRecord);
+            header.count = m_count;
+            header.recordsOffset = sizeof(ReplayHeader);
+            return header;
+        }
+
+        void flush() {
+            m_out.write(reinterpret_cast<const char*>(m_buffer.data()),
+                static_cast<std::streamsize>(m_buffer.size() * sizeof(MeasurementRecord)));
+            m_buffer.clear();
+        }
+
+        std::string m_path;
+        std::ofstream m_out;
+        std::vector<MeasurementRecord> m_buffer;
+        std::uint64_t m_count;
+};
+
+// Parses one CSV line, returns false for anything that is not four numbers.
+static bool parseCsvLine(const char* line, MeasurementRecord& record)
+{
+    char* end = nullptr;
+    record.timestamp = std::strtoll(line, &end, 10);
+    if(end == line)
+    {
+        return false;
+    }
+    float* fields[3] = {&record.temperature, &record.humidity, &record.pressure};
+    for(float* field : fields)
+    {
+        if(*end != ',')
+        {
+            return false;
+        }
+        const char* start = end + 1;
+        *field = std::strtof(start, &end);
+        if(end == start)
+        {
+            return false;
+        }
+    }
+    // trailing blanks and a CRLF line end are fine, extra columns and junk are not
+    while(std::isspace(static_cast<unsigned char>(*end)))
+    {
+        ++end;
+    }
+    if(*end != '\0')
+    {
+        return false;
+    }
+    record.reserved = 0;
+    return true;
+}
+
+// A replay speed: a non-negative decimal number, nothing else on the argument.
+static bool parseSpeed(const char* text, double& speed)
+{
+    if(!std::isdigit(static_cast<unsigned char>(text[0])) && text[0] != '.')
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const double parsed = std::strtod(text, &end);
+    if(end == text || *end != '\0' || errno != 0 || !std::isfinite(parsed) || parsed < 0.0)
+    {
+        return false;
+    }
+    speed = parsed;
+    return true;
+}
+
+static std::uint64_t convertCsv(const std::string& csvPath, const std::string& replayPath)
+{
+    std::ifstream in(csvPath);
+    if(!in)
+    {
+        throw std::runtime_error("could not open " + csvPath);
+    }
+
+    ReplayWriter writer(replayPath);
+    std::string line;
+    std::uint64_t lineNumber = 0;
+    std::int64_t lastTimestamp = INT64_MIN;
+    while(std::getline(in, line))
+    {
+        ++lineNumber;
+        if(line.empty() || (lineNumber == 1 && !std::isdigit(static_cast<unsigned char>(line[0])) && line[0] != '-'))
+        {
+            continue;
+        }
+        MeasurementRecord record{};
+        if(!parseCsvLine(line.c_str(), record))
+        {
+            throw std::runtime_error(csvPath + ":" + std::to_string(lineNumber) + ": not a measurement");
+        }
+        if(record.timestamp < lastTimestamp)
+        {
+            throw std::runtime_error(csvPath + ":" + std::to_string(lineNumber) + ": timestamp goes backwards");
+        }
+        lastTimestamp = record.timestamp;
+        writer.add(record);
+    }
+    return writer.close();
+}
+
+/* *********************************************
+* A replay file mapped read only. The records are
+* used in place, nothing is copied.
+********************************************* */
+
+class MappedMeasurements {
+
+    public:
+        explicit MappedMeasurements(const std::string& path) : m_data(nullptr), m_length(0), m_records(nullptr), m_count(0)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0)
+            {
+                throw std::runtime_error("could not open replay file " + path);
+            }
+
+            struct stat info{};
+            if(::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(ReplayHeader)))
+            {
+                ::close(fd);
+                throw std::runtime_error("replay file too small: " + path);
+            }
+
+            m_length = static_cast<std::size_t>(info.st_size);
+            void* data = ::mmap(nullptr, m_length, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if(data == MAP_FAILED)
+            {
+                throw std::runtime_error("could not map replay file " + path);
+            }
+            m_data = static_cast<unsigned char*>(data);
+
+            try
+            {
+                validate();
+            }
+            catch(...)
+            {
+                ::munmap(m_data, m_length);
+                throw;
+            }
+            ::madvise(m_data, m_length, MADV_SEQUENTIAL);
+        }
+
+        ~MappedMeasurements() {
+            ::munmap(m_data, m_length);
+        }
+
+        MappedMeasurements(const MappedMeasurements&) = delete;
+        MappedMeasurements& operator=(const MappedMeasurements&) = delete;
+
+        const MeasurementRecord* begin() const {
+            return m_records;
+        }
+
+        const MeasurementRecord* end() const {
+            return m_records + m_count;
+        }
+
+        std::size_t size() const {
+            return m_count;
+        }
+
+        // Asks the kernel to start reading records [first, first + count); the range is cut at the last record.
+        void willNeed(std::size_t first, std::size_t count) const {
+            advise(first, count, MADV_WILLNEED);
+        }
+
+        // The replay is past records [first, first + count), the pages may go.
+        void doneWith(std::size_t first, std::size_t count) const {
+            advise(first, count, MADV_DONTNEED);
+        }
+
+    private:
+        void validate() {
+            ReplayHeader header;
+            std::memcpy(&header, m_data, sizeof(header));
+
+            if(std::memcmp(header.magic, replayMagic, sizeof(header.magic)) != 0)
+            {
+                throw std::runtime_error("not a replay file");
+            }
+            if(header.version != replayVersion)
+            {
+                throw std::runtime_error("unsupported replay version " + std::to_string(header.version));
+            }
+            if(header.byteOrder != replayByteOrder || header.recordSize != sizeof(MeasurementRecord))
+            {
+                throw std::runtime_error("replay file written by an incompatible build");
+            }
+            if(header.recordsOffset % alignof(MeasurementRecord) != 0 || header.recordsOffset > m_length
+                || header.count > (m_length - header.recordsOffset) / sizeof(MeasurementRecord))
+            {
+                throw std::runtime_error("replay file truncated or corrupt");
+            }
+
+            m_records = reinterpret_cast<const MeasurementRecord*>(static_cast<const void*>(m_data + header.recordsOffset));
+            m_count = static_cast<std::size_t>(header.count);
+        }
+
+        // madvise wants page aligned addresses; offsets are computed before any pointer is formed
+        void advise(std::size_t firstRecord, std::size_t count, int advice) const {
+            static const std::size_t pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t begin = std::min(firstRecord, m_count);
+            const std::size_t end = begin + std::min(count, m_count - begin);
+            const std::size_t recordsOffset = static_cast<std::size_t>(reinterpret_cast<const unsigned char*>(m_records) - m_data);
+            const std::size_t first = (recordsOffset + begin * sizeof(MeasurementRecord)) / pageSize * pageSize;
+            const std::size_t last = recordsOffset + end * sizeof(MeasurementRecord);
+            if(begin < end)
+            {
+                ::madvise(m_data + first, last - first, advice);
+            }
+        }
+
+        unsigned char* m_data;
+        std::size_t m_length;
+        const MeasurementRecord* m_records;
+        std::size_t m_count;
+};
+
+struct ReplayStats {
+    std::size_t records;
+    double seconds;
+
+    double recordsPerSecond() const {
+        return static_cast<double>(records) / seconds;
+    }
+
+    double megabytesPerSecond() const {
+        return static_cast<double>(records * sizeof(MeasurementRecord)) / seconds / 1e6;
+    }
+};
+
+/* *********************************************
+* Feeds the records to the weather data. A speed of
+* 1 keeps the recorded spacing, 2 replays twice as
+* fast and 0 does not wait at all.
+*
+* The file is consumed in windows: while one window
+* is replayed the next one is already being read, and
+* the one before is released.
+********************************************* */
+
+static ReplayStats replay(const MappedMeasurements& measurements, WeatherData& weatherData, double speed)
+{
+    static constexpr std::size_t windowRecords = (32u << 20) / sizeof(MeasurementRecord);
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::int64_t firstTimestamp = measurements.size() > 0 ? measurements.begin()->timestamp : 0;
+
+    measurements.willNeed(0, 2 * windowRecords);
+    std::size_t index = 0;
+    for(const MeasurementRecord* record = measurements.begin(); record != measurements.end(); ++record, ++index)
+    {
+        if(index % windowRecords == 0 && index > 0)
+        {
+            measurements.willNeed(index + windowRecords, windowRecords);
+            measurements.doneWith(index - windowRecords, windowRecords);
+        }
+        if(speed > 0.0)
+        {
+            const auto due = std::chrono::nanoseconds(static_cast<std::int64_t>(static_cast<double>(record->timestamp - firstTimestamp) / speed));
+            std::this_thread::sleep_until(start + due);
+        }
+        weatherData.setMeasurements(record->temperature, record->humidity, record->pressure);
+    }
+
+    return ReplayStats{measurements.size(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+}
+
+// What the tools did before: parse the CSV line by line while replaying.
+static ReplayStats replayCsv(const std::string& csvPath, WeatherData& weatherData)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::ifstream in(csvPath);
+    std::string line;
+    std::size_t records = 0;
+    while(std::getline(in, line))
+    {
+        MeasurementRecord record{};
+        if(parseCsvLine(line.c_str(), record))
+        {
+            weatherData.setMeasurements(record.temperature, record.humidity, record.pressure);
+            ++records;
+        }
+    }
+    return ReplayStats{records, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+}
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// Adds up everything it sees, to compare two replays of the same traffic.
+class ChecksumDisplay : public Observer {
+    public:
+        ChecksumDisplay() : m_sum(0.0), m_updates(0)
+        {
+
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_sum += static_cast<double>(temperature) + humidity + pressure;
+            ++m_updates;
+        }
+
+        double sum() const {
+            return m_sum;
+        }
+
+        std::uint64_t updates() const {
+            return m_updates;
+        }
+
+    private:
+        double m_sum;
+        std::uint64_t m_updates;
+};
+
+static void printStats(const char* name, const ReplayStats& stats, const ChecksumDisplay& checksum)
+{
+    std::cout << name << ": " << stats.records << " records in " << stats.seconds * 1e3 << " ms, "
+              << stats.recordsPerSecond() / 1e6 << "M records/s, " << stats.megabytesPerSecond()
+              << " MB/s, checksum " << checksum.sum() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const std::string command = argc > 1 ? argv[1] : "";
+        if(command == "convert" && argc == 4)
+        {
+            std::uint64_t records = convertCsv(argv[2], argv[3]);
+            std::cout << "wrote " << records << " records to " << argv[3] << std::endl;
+            return 0;
+        }
+        double speed = 0.0;
+        if(command == "replay" && (argc == 3 || (argc == 4 && parseSpeed(argv[3], speed))))
+        {
+            MappedMeasurements measurements(argv[2]);
+            WeatherData weatherData;
+            ChecksumDisplay checksum;
+            weatherData.registerObserver(&checksum);
+            printStats("replay", replay(measurements, weatherData, speed), checksum);
+            return 0;
+        }
+        if(!command.empty())
+        {
+            std::cerr << "usage: " << argv[0] << " [convert <in.csv> <out.replay> | replay <file.replay> [speed]]" << std::endl;
+            return 1;
+        }
+
+        std::cout << "chapter 2 - observer fed from a memory-mapped replay" << std::endl;
+
+        const std::string csvPath = "measurements.csv";
+        const std::string replayPath = "measurements.replay";
+
+        /* *********************************************
+        * Record five million measurements, one every
+        * millisecond, as CSV the way a logger would.
+        ********************************************* */
+
+        const std::size_t recordCount = 5000000;
+        {
+            std::ofstream csv(csvPath);
+            csv << "timestamp_ns,temperature,humidity,pressure\n";
+            char line[96];
+            for(std::size_t i = 0; i < recordCount; ++i)
+            {
+                const float temperature = 20.0f + static_cast<float>(i % 1000) * 0.01f;
+                const float humidity = 50.0f + static_cast<float>(i % 300) * 0.1f;
+                const float pressure = 29.2f + static_cast<float>(i % 50) * 0.001f;
+                const int length = std::snprintf(line, sizeof(line), "%lld,%.9g,%.9g,%.9g\n",
+                    static_cast<long long>(i) * 1000000LL, temperature, humidity, pressure);
+                csv.write(line, length);
+            }
+        }
+
+        auto convertStart = std::chrono::steady_clock::now();
+        std::uint64_t converted = convertCsv(csvPath, replayPath);
+        double convertSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - convertStart).count();
+        std::cout << "converted " << converted << " CSV lines in " << convertSeconds * 1e3 << " ms" << std::endl;
+
+        // the readings from the book, recorded a second apart and replayed ten times faster
+        {
+            const std::string samplePath = "sample.replay";
+            {
+                ReplayWriter writer(samplePath);
+                writer.add(MeasurementRecord{0, 12.0f, 65.0f, 29.2f, 0});
+                writer.add(MeasurementRecord{1000000000, 20.0f, 55.0f, 29.2f, 0});
+                writer.add(MeasurementRecord{2000000000, 24.0f, 45.0f, 29.2f, 0});
+            }
+
+            MappedMeasurements sample(samplePath);
+            WeatherData weatherData;
+            CurrentConditionsDisplay currentDisplay(&weatherData);
+            ReplayStats stats = replay(sample, weatherData, 10.0);
+            std::cout << "replayed " << stats.records << " records at 10x in " << stats.seconds * 1e3 << " ms"
+                      << std::endl << std::endl;
+            std::remove(samplePath.c_str());
+        }
+
+        /* *********************************************
+        * Ingest throughput at maximum speed, parsing the
+        * CSV against replaying the mapped records.
+        ********************************************* */
+
+        {
+            WeatherData weatherData;
+            ChecksumDisplay checksum;
+            weatherData.registerObserver(&checksum);
+            printStats("csv parse ", replayCsv(csvPath, weatherData), checksum);
+        }
+        {
+            WeatherData weatherData;
+            ChecksumDisplay checksum;
+            weatherData.registerObserver(&checksum);
+            MappedMeasurements measurements(replayPath);
+            printStats("mmap replay", replay(measurements, weatherData, 0.0), checksum);
+        }
+
+        std::remove(csvPath.c_str());
+        std::remove(replayPath.c_str());
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,304 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with a pull API next to the push one.
+* Consumers that poll on their own schedule call
+* WeatherData::snapshot() instead of registering.
+*
+* The measurements are guarded by a seqlock: the
+* writer makes the sequence number odd, stores the
+* values and makes it even again. It never waits for
+* anybody. A reader copies the values and retries if
+* the sequence number was odd or moved meanwhile.
+* Half the sequence number is the version, so a poller
+* finds out whether anything changed with one load.
+*
+* setMeasurements must be called from one thread at a
+* time; snapshot() from any number of threads.
+********************************************* */
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <list>
+#include <algorithm>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+struct WeatherSnapshot {
+    float temperature;
+    float humidity;
+    float pressure;
+    std::uint64_t version;
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+
+        // the values are atomics only so that a racing read is not undefined behaviour, all accesses are relaxed
+        alignas(64) std::atomic<std::uint64_t> m_sequence;
+        std::atomic<float> m_temperature;
+        std::atomic<float> m_humidity;
+        std::atomic<float> m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_sequence(0), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            const float temperature = m_temperature.load(std::memory_order_relaxed);
+            const float humidity = m_humidity.load(std::memory_order_relaxed);
+            const float pressure = m_pressure.load(std::memory_order_relaxed);
+            for(auto observer : m_observers)
+            {
+                observer->update(temperature, humidity, pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            const std::uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+            m_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            m_temperature.store(temperature, std::memory_order_relaxed);
+            m_humidity.store(humidity, std::memory_order_relaxed);
+            m_pressure.store(pressure, std::memory_order_relaxed);
+
+            m_sequence.store(sequence + 2, std::memory_order_release);
+            measurementsChanged();
+        }
+
+        // A consistent copy of the latest measurements. Lock-free, retries while a write is in progress.
+        WeatherSnapshot snapshot() const {
+            while(true)
+            {
+                const std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+                if(before & 1)
+                {
+                    continue;
+                }
+
+                WeatherSnapshot result{m_temperature.load(std::memory_order_relaxed),
+                                       m_humidity.load(std::memory_order_relaxed),
+                                       m_pressure.load(std::memory_order_relaxed), before / 2};
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(m_sequence.load(std::memory_order_relaxed) == before)
+                {
+                    return result;
+                }
+            }
+        }
+
+        std::uint64_t version() const {
+            return m_sequence.load(std::memory_order_acquire) / 2;
+        }
+
+        // Fills `result` and returns true only when there is something newer than `seen`.
+        bool snapshotIfChanged(std::uint64_t seen, WeatherSnapshot& result) const {
+            if(version() == seen)
+            {
+                return false;
+            }
+            result = snapshot();
+            return result.version != seen;
+        }
+
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// Not an observer: it pulls a snapshot whenever it wants to redraw.
+class PollingDisplay : public DisplayElement {
+    private:
+        const WeatherData& m_weatherData;
+        WeatherSnapshot m_last;
+
+    public:
+        PollingDisplay(const WeatherData& weatherData) : m_weatherData(weatherData), m_last{0, 0, 0, 0}
+        {
+
+        }
+
+        PollingDisplay(const PollingDisplay&) = default;
+        PollingDisplay& operator=(const PollingDisplay&) = delete;
+
+        void poll() {
+            if(m_weatherData.snapshotIfChanged(m_last.version, m_last))
+            {
+                display();
+            }
+            else
+            {
+                std::cout << "Polling display: nothing new since version " << m_last.version << std::endl;
+            }
+        }
+
+        void display() override {
+            std::cout << "Polling display: version " << m_last.version << ", " << m_last.temperature << "°C, "
+                      << m_last.humidity << "% humidity, " << m_last.pressure << " inHg" << std::endl;
+        }
+};
+
+// one cache line per reader, the counters are bumped on every poll
+struct alignas(64) ReaderResult {
+    std::uint64_t snapshots;
+    std::uint64_t changes;
+    std::uint64_t torn;
+};
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with a seqlock snapshot" << std::endl;
+
+    {
+        WeatherData weatherData;
+        CurrentConditionsDisplay currentDisplay(&weatherData);
+        PollingDisplay pollingDisplay(weatherData);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        pollingDisplay.poll();
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        pollingDisplay.poll();
+        pollingDisplay.poll();
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: one writer calls setMeasurements as fast
+    * as it can while readers poll snapshots. Every write
+    * keeps humidity = 2 * temperature and pressure =
+    * 3 * temperature, so a torn snapshot would show.
+    ********************************************* */
+
+    const std::chrono::milliseconds duration(300);
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<unsigned> readerCounts{0, 1, 3};
+    if(hardwareThreads > 3)
+    {
+        readerCounts.push_back(hardwareThreads);
+    }
+
+    for(unsigned readers : readerCounts)
+    {
+        WeatherData weatherData;
+        std::atomic<bool> running(true);
+        std::vector<ReaderResult> results(readers, ReaderResult{0, 0, 0});
+        std::vector<std::thread> threads;
+
+        for(unsigned r = 0; r < readers; ++r)
+        {
+            threads.emplace_back([&weatherData, &running, &result = results[r]](){
+                std::uint64_t seen = 0;
+                WeatherSnapshot snapshot{0, 0, 0, 0};
+                while(running.load(std::memory_order_relaxed))
+                {
+                    ++result.snapshots;
+                    if(weatherData.snapshotIfChanged(seen, snapshot))
+                    {
+                        seen = snapshot.version;
+                        ++result.changes;
+                        if(snapshot.humidity != 2.0f * snapshot.temperature || snapshot.pressure != 3.0f * snapshot.temperature)
+                        {
+                            ++result.torn;
+                        }
+                    }
+                }
+            });
+        }
+
+        std::uint64_t writes = 0;
+        auto start = std::chrono::steady_clock::now();
+        while(std::chrono::steady_clock::now() - start < duration)
+        {
+            for(int i = 0; i < 1024; ++i, ++writes)
+            {
+                // small integers are exact in a float, so the products are too
+                const float value = static_cast<float>(writes & 0xffff);
+                weatherData.setMeasurements(value, 2.0f * value, 3.0f * value);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        running = false;
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        ReaderResult total{0, 0, 0};
+        for(const auto& result : results)
+        {
+            total.snapshots += result.snapshots;
+            total.changes += result.changes;
+            total.torn += result.torn;
+        }
+
+        std::cout << readers << " readers: writer " << writes / seconds / 1e6 << "M updates/s, readers "
+                  << total.snapshots / seconds / 1e6 << "M polls/s of which " << total.changes
+                  << " saw a new version, torn snapshots: " << total.torn << std::endl;
+    }
+}
@@ -0,0 +1,863 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern across processes. WeatherData publishes
+* into a ring buffer in POSIX shared memory, and
+* display processes attach to it by name and drive
+* their own local observers from it: no sockets, no
+* serialization, and a crashing display cannot take
+* the ingest process down.
+*
+* One producer, any number of consumers. Every
+* consumer keeps its own cursor in the segment. The
+* producer never waits for anybody: slots are
+* overwritten in order, each under its own sequence
+* number, so a reader can tell a slot it is allowed
+* to read from one that was overwritten under it.
+* A consumer that was overrun skips to the newest
+* measurement and counts what it missed.
+*
+* Every few thousand measurements the producer looks
+* at the cursors: consumers that fall more than 3/4 of
+* the ring behind are flagged as lagging, and slots of
+* processes that no longer exist are freed.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <list>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+};
+
+/* *********************************************
+* Segment layout: header, consumer table, slots, each
+* on its own cache lines. Everything that two processes
+* touch is a lock-free atomic, which is address-free
+* and so works between different mappings.
+********************************************* */
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+static_assert(std::atomic<float>::is_always_lock_free, "shared atomics must be lock-free");
+
+static const char ringMagic[8] = {'W', 'X', 'S', 'H', 'R', 'I', 'N', 'G'};
+static constexpr std::uint32_t ringVersion = 1;
+static constexpr std::uint32_t byteOrderMark = 0x01020304;
+
+// The magic as the header stores it: the eight characters in one word, so it can be published atomically.
+static std::uint64_t ringMagicWord()
+{
+    std::uint64_t word;
+    std::memcpy(&word, ringMagic, sizeof(word));
+    return word;
+}
+
+struct alignas(64) RingHeader {
+    // stored last, with release: a segment without it is not (yet) a weather ring
+    std::atomic<std::uint64_t> magic;
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t capacity;
+    std::uint32_t maxConsumers;
+    std::atomic<std::uint32_t> closed;
+    std::atomic<std::uint64_t> reclaimed;
+    // measurements published so far; written by the producer only
+    alignas(64) std::atomic<std::uint64_t> head;
+};
+
+enum ConsumerState : std::uint32_t { Free, Joining, Attached };
+
+struct alignas(64) ConsumerSlot {
+    std::atomic<std::uint32_t> state;
+    std::atomic<std::int32_t> pid;
+    // written by the consumer
+    std::atomic<std::uint64_t> cursor;
+    std::atomic<std::uint64_t> skipped;
+    // written by the producer
+    std::atomic<std::uint32_t> lagging;
+    std::atomic<std::uint64_t> flagged;
+};
+
+// sequence is 2 * n + 1 while measurement n is written into the slot and 2 * n + 2 once it is complete
+struct alignas(32) RingSlot {
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<float> temperature;
+    std::atomic<float> humidity;
+    std::atomic<float> pressure;
+};
+
+struct Measurement {
+    float temperature;
+    float humidity;
+    float pressure;
+};
+
+struct ConsumerStatus {
+    bool attached;
+    bool lagging;
+    std::uint64_t cursor;
+    std::uint64_t skipped;
+    std::uint64_t flagged;
+};
+
+static std::size_t alignUp(std::size_t offset)
+{
+    return (offset + 63) & ~static_cast<std::size_t>(63);
+}
+
+class SharedWeatherRing {
+
+    public:
+        // Creates the segment; capacity is rounded up to a power of two. The creator unlinks it again.
+        SharedWeatherRing(const std::string& name, std::uint32_t capacity, std::uint32_t maxConsumers)
+            : m_name(name), m_owner(true), m_data(nullptr), m_length(0), m_header(nullptr), m_consumers(nullptr), m_slots(nullptr),
+              m_mask(0), m_next(0)
+        {
+            if(maxConsumers == 0)
+            {
+                throw std::runtime_error("a weather ring needs at least one consumer slot");
+            }
+            std::uint32_t rounded = 1;
+            while(rounded < std::max<std::uint32_t>(capacity, 8))
+            {
+                rounded <<= 1;
+            }
+
+            int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if(fd < 0)
+            {
+                throw std::runtime_error("could not create shared memory " + name + ": " + std::strerror(errno));
+            }
+            m_length = segmentLength(rounded, maxConsumers);
+            if(::ftruncate(fd, static_cast<off_t>(m_length)) != 0)
+            {
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                throw std::runtime_error("could not size shared memory " + name);
+            }
+            map(fd);
+
+            m_header = new (m_data) RingHeader();
+            m_header->magic.store(0, std::memory_order_relaxed);
+            m_header->version = ringVersion;
+            m_header->byteOrder = byteOrderMark;
+            m_header->capacity = rounded;
+            m_header->maxConsumers = maxConsumers;
+            m_header->closed.store(0, std::memory_order_relaxed);
+            m_header->reclaimed.store(0, std::memory_order_relaxed);
+            m_header->head.store(0, std::memory_order_relaxed);
+            locate();
+            for(std::uint32_t i = 0; i < maxConsumers; ++i)
+            {
+                ConsumerSlot* consumer = new (&m_consumers[i]) ConsumerSlot();
+                consumer->state.store(Free, std::memory_order_relaxed);
+                consumer->pid.store(0, std::memory_order_relaxed);
+                consumer->cursor.store(0, std::memory_order_relaxed);
+                consumer->skipped.store(0, std::memory_order_relaxed);
+                consumer->lagging.store(0, std::memory_order_relaxed);
+                consumer->flagged.store(0, std::memory_order_relaxed);
+            }
+            for(std::uint32_t i = 0; i < rounded; ++i)
+            {
+                RingSlot* slot = new (&m_slots[i]) RingSlot();
+                slot->sequence.store(0, std::memory_order_relaxed);
+            }
+            m_header->magic.store(ringMagicWord(), std::memory_order_release);
+        }
+
+        // Opens a segment that another process created.
+        explicit SharedWeatherRing(const std::string& name)
+            : m_name(name), m_owner(false), m_data(nullptr), m_length(0), m_header(nullptr), m_consumers(nullptr), m_slots(nullptr),
+              m_mask(0), m_next(0)
+        {
+            int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+            if(fd < 0)
+            {
+                throw std::runtime_error("could not open shared memory " + name + ": " + std::strerror(errno));
+            }
+            struct stat status;
+            if(::fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(RingHeader))
+            {
+                ::close(fd);
+                throw std::runtime_error("shared memory too small: " + name);
+            }
+            m_length = static_cast<std::size_t>(status.st_size);
+            map(fd);
+
+            m_header = static_cast<RingHeader*>(m_data);
+            if(m_header->magic.load(std::memory_order_acquire) != ringMagicWord())
+            {
+                release();
+                throw std::runtime_error("not a weather ring, or not initialised yet: " + name);
+            }
+            if(m_header->version != ringVersion)
+            {
+                release();
+                throw std::runtime_error("unsupported weather ring version " + std::to_string(m_header->version));
+            }
+            if(m_header->byteOrder != byteOrderMark)
+            {
+                release();
+                throw std::runtime_error("weather ring written by an incompatible build");
+            }
+            const std::uint32_t capacity = m_header->capacity;
+            if(capacity == 0 || (capacity & (capacity - 1)) != 0 || m_header->maxConsumers == 0)
+            {
+                release();
+                throw std::runtime_error("weather ring header corrupt: " + name);
+            }
+            if(segmentLength(capacity, m_header->maxConsumers) > m_length)
+            {
+                release();
+                throw std::runtime_error("weather ring truncated: " + name);
+            }
+            locate();
+        }
+
+        ~SharedWeatherRing() {
+            release();
+            if(m_owner)
+            {
+                ::shm_unlink(m_name.c_str());
+            }
+        }
+
+        SharedWeatherRing(const SharedWeatherRing&) = delete;
+        SharedWeatherRing& operator=(const SharedWeatherRing&) = delete;
+
+        std::uint32_t capacity() const {
+            return m_header->capacity;
+        }
+
+        std::uint32_t maxConsumers() const {
+            return m_header->maxConsumers;
+        }
+
+        std::uint64_t published() const {
+            return m_header->head.load(std::memory_order_acquire);
+        }
+
+        std::uint64_t reclaimed() const {
+            return m_header->reclaimed.load(std::memory_order_relaxed);
+        }
+
+        // Producer side. Never waits for a consumer.
+        void publish(float temperature, float humidity, float pressure) {
+            const std::uint64_t sequence = m_next++;
+            RingSlot& slot = m_slots[sequence & m_mask];
+            slot.sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.temperature.store(temperature, std::memory_order_relaxed);
+            slot.humidity.store(humidity, std::memory_order_relaxed);
+            slot.pressure.store(pressure, std::memory_order_relaxed);
+            slot.sequence.store(2 * sequence + 2, std::memory_order_release);
+            m_header->head.store(m_next, std::memory_order_release);
+
+            if((m_next & (checkInterval() - 1)) == 0)
+            {
+                checkConsumers();
+            }
+        }
+
+        // Tells the consumers that nothing more will come.
+        void close() {
+            checkConsumers();
+            m_header->closed.store(1, std::memory_order_release);
+        }
+
+        bool closed() const {
+            return m_header->closed.load(std::memory_order_acquire) != 0;
+        }
+
+        // Flags consumers that fell behind and frees the slots of processes that are gone.
+        void checkConsumers() {
+            const std::uint64_t head = m_header->head.load(std::memory_order_relaxed);
+            for(std::uint32_t i = 0; i < m_header->maxConsumers; ++i)
+            {
+                ConsumerSlot& consumer = m_consumers[i];
+                if(consumer.state.load(std::memory_order_acquire) != Attached)
+                {
+                    continue;
+                }
+                const pid_t pid = consumer.pid.load(std::memory_order_relaxed);
+                if(::kill(pid, 0) != 0 && errno == ESRCH)
+                {
+                    std::uint32_t attached = Attached;
+                    if(consumer.state.compare_exchange_strong(attached, Free, std::memory_order_acq_rel))
+                    {
+                        m_header->reclaimed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    continue;
+                }
+                const std::uint64_t behind = head - std::min(head, consumer.cursor.load(std::memory_order_relaxed));
+                if(behind > m_header->capacity / 4 * 3)
+                {
+                    if(consumer.lagging.exchange(1, std::memory_order_relaxed) == 0)
+                    {
+                        consumer.flagged.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                else if(behind < m_header->capacity / 4)
+                {
+                    consumer.lagging.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Consumer side. Returns the consumer's index; it starts at the next measurement.
+        std::uint32_t attach() {
+            for(std::uint32_t i = 0; i < m_header->maxConsumers; ++i)
+            {
+                ConsumerSlot& consumer = m_consumers[i];
+                std::uint32_t free = Free;
+                if(!consumer.state.compare_exchange_strong(free, Joining, std::memory_order_acq_rel))
+                {
+                    continue;
+                }
+                consumer.pid.store(static_cast<std::int32_t>(::getpid()), std::memory_order_relaxed);
+                consumer.cursor.store(m_header->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+                consumer.skipped.store(0, std::memory_order_relaxed);
+                consumer.lagging.store(0, std::memory_order_relaxed);
+                consumer.flagged.store(0, std::memory_order_relaxed);
+                consumer.state.store(Attached, std::memory_order_release);
+                return i;
+            }
+            throw std::runtime_error("weather ring has no free consumer slot");
+        }
+
+        void detach(std::uint32_t index) {
+            m_consumers[index].state.store(Free, std::memory_order_release);
+        }
+
+        std::uint32_t attachedConsumers() const {
+            std::uint32_t attached = 0;
+            for(std::uint32_t i = 0; i < m_header->maxConsumers; ++i)
+            {
+                attached += m_consumers[i].state.load(std::memory_order_acquire) == Attached ? 1u : 0u;
+            }
+            return attached;
+        }
+
+        // The next measurement for this consumer, if there is one. An overrun consumer skips to the newest.
+        bool read(std::uint32_t index, Measurement& measurement) {
+            ConsumerSlot& consumer = m_consumers[index];
+            std::uint64_t cursor = consumer.cursor.load(std::memory_order_relaxed);
+            while(true)
+            {
+                const std::uint64_t head = m_header->head.load(std::memory_order_acquire);
+                if(cursor >= head)
+                {
+                    return false;
+                }
+                if(head - cursor <= m_header->capacity)
+                {
+                    const RingSlot& slot = m_slots[cursor & m_mask];
+                    const std::uint64_t expected = 2 * cursor + 2;
+                    const std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+                    measurement.temperature = slot.temperature.load(std::memory_order_relaxed);
+                    measurement.humidity = slot.humidity.load(std::memory_order_relaxed);
+                    measurement.pressure = slot.pressure.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    const std::uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+                    if(before == expected && after == expected)
+                    {
+                        consumer.cursor.store(cursor + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                // overrun: go on with the newest measurement
+                const std::uint64_t newest = m_header->head.load(std::memory_order_acquire) - 1;
+                consumer.skipped.fetch_add(newest - cursor, std::memory_order_relaxed);
+                cursor = newest;
+                consumer.cursor.store(cursor, std::memory_order_relaxed);
+            }
+        }
+
+        ConsumerStatus status(std::uint32_t index) const {
+            const ConsumerSlot& consumer = m_consumers[index];
+            return ConsumerStatus{consumer.state.load(std::memory_order_acquire) == Attached,
+                                  consumer.lagging.load(std::memory_order_relaxed) != 0,
+                                  consumer.cursor.load(std::memory_order_relaxed),
+                                  consumer.skipped.load(std::memory_order_relaxed),
+                                  consumer.flagged.load(std::memory_order_relaxed)};
+        }
+
+    private:
+        static std::size_t segmentLength(std::uint32_t capacity, std::uint32_t maxConsumers) {
+            return alignUp(sizeof(RingHeader)) + alignUp(sizeof(ConsumerSlot) * maxConsumers) + sizeof(RingSlot) * capacity;
+        }
+
+        std::uint64_t checkInterval() const {
+            return std::max<std::uint64_t>(1, m_header->capacity / 8);
+        }
+
+        void map(int fd) {
+            void* data = ::mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if(data == MAP_FAILED)
+            {
+                if(m_owner)
+                {
+                    ::shm_unlink(m_name.c_str());
+                }
+                throw std::runtime_error("could not map shared memory " + m_name);
+            }
+            m_data = data;
+        }
+
+        void locate() {
+            char* base = static_cast<char*>(m_data);
+            m_consumers = reinterpret_cast<ConsumerSlot*>(base + alignUp(sizeof(RingHeader)));
+            m_slots = reinterpret_cast<RingSlot*>(base + alignUp(sizeof(RingHeader)) + alignUp(sizeof(ConsumerSlot) * m_header->maxConsumers));
+            m_mask = m_header->capacity - 1;
+            m_next = m_header->head.load(std::memory_order_relaxed);
+        }
+
+        void release() {
+            if(m_data != nullptr)
+            {
+                ::munmap(m_data, m_length);
+                m_data = nullptr;
+            }
+        }
+
+        std::string m_name;
+        bool m_owner;
+        void* m_data;
+        std::size_t m_length;
+        RingHeader* m_header;
+        ConsumerSlot* m_consumers;
+        RingSlot* m_slots;
+        std::uint64_t m_mask;
+        std::uint64_t m_next;
+};
+
+// Registered on the ingest side's WeatherData; every update goes into the ring.
+class SharedMemoryPublisher : public Observer {
+    private:
+        SharedWeatherRing& m_ring;
+        Subject* m_weatherData;
+
+    public:
+        SharedMemoryPublisher(Subject* weatherData, SharedWeatherRing& ring) : m_ring(ring), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        SharedMemoryPublisher(const SharedMemoryPublisher&) = delete;
+        SharedMemoryPublisher& operator=(const SharedMemoryPublisher&) = delete;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_ring.publish(temperature, humidity, pressure);
+        }
+};
+
+/* *********************************************
+* The subject on the display side: attached to the ring
+* as one consumer, it hands what poll() finds to its
+* local observers like any WeatherData would.
+********************************************* */
+
+class RemoteWeatherData : public Subject {
+    private:
+        SharedWeatherRing& m_ring;
+        std::uint32_t m_consumer;
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        explicit RemoteWeatherData(SharedWeatherRing& ring)
+            : m_ring(ring), m_consumer(ring.attach()), m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        ~RemoteWeatherData() override {
+            m_ring.detach(m_consumer);
+        }
+
+        RemoteWeatherData(const RemoteWeatherData&) = delete;
+        RemoteWeatherData& operator=(const RemoteWeatherData&) = delete;
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        // Delivers up to `limit` waiting measurements, returns how many.
+        std::size_t poll(std::size_t limit = 1024) {
+            std::size_t delivered = 0;
+            Measurement measurement{0, 0, 0};
+            while(delivered < limit && m_ring.read(m_consumer, measurement))
+            {
+                m_temperature = measurement.temperature;
+                m_humidity = measurement.humidity;
+                m_pressure = measurement.pressure;
+                notifyObservers();
+                ++delivered;
+            }
+            return delivered;
+        }
+
+        // True once the producer closed the ring and everything was read.
+        bool finished() {
+            return m_ring.closed() && poll() == 0;
+        }
+
+        ConsumerStatus status() const {
+            return m_ring.status(m_consumer);
+        }
+};
+
+class CurrentConditionsDisplay : public Observer, public DisplayElement {
+    private:
+        float m_temperature;
+        float m_humidity;
+        Subject* m_weatherData;
+
+    public:
+        CurrentConditionsDisplay(Subject* weatherData) : m_temperature(0), m_humidity(0), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        CurrentConditionsDisplay(const CurrentConditionsDisplay&) = default;
+        CurrentConditionsDisplay& operator=(const CurrentConditionsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            m_temperature = temperature;
+            m_humidity = humidity;
+            (void)pressure; // just to avoid compilation fail
+            display();
+        }
+
+        void display() override {
+            std::cout << "Current conditions: " << m_temperature << "°C" << " and " << m_humidity << "% humidity" << std::endl;
+        }
+
+};
+
+// Checks that every measurement arrived whole: the benchmark publishes t, t + 1, t + 2.
+class CheckingDisplay : public Observer {
+    public:
+        CheckingDisplay(Subject* weatherData, std::uint64_t delay, std::uint64_t crashAfter)
+            : m_received(0), m_torn(0), m_delay(delay), m_crashAfter(crashAfter)
+        {
+            weatherData->registerObserver(this);
+        }
+
+        void update(float temperature, float humidity, float pressure) override {
+            if(humidity != temperature + 1.0f || pressure != temperature + 2.0f)
+            {
+                ++m_torn;
+            }
+            ++m_received;
+            if(m_delay != 0 && m_received % 64 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(m_delay));
+            }
+            if(m_crashAfter != 0 && m_received == m_crashAfter)
+            {
+                // dies without detaching, as a crashed display would
+                std::cout.flush();
+                ::_exit(3);
+            }
+        }
+
+        std::uint64_t received() const {
+            return m_received;
+        }
+
+        std::uint64_t torn() const {
+            return m_torn;
+        }
+
+    private:
+        std::uint64_t m_received;
+        std::uint64_t m_torn;
+        std::uint64_t m_delay;
+        std::uint64_t m_crashAfter;
+};
+
+// Runs in a forked display process; never returns.
+static void runDisplayProcess(const std::string& name, const char* label, std::uint64_t delay, std::uint64_t crashAfter)
+{
+    int code = 0;
+    try
+    {
+        SharedWeatherRing ring(name);
+        RemoteWeatherData weatherData(ring);
+        CheckingDisplay display(&weatherData, delay, crashAfter);
+        while(!weatherData.finished())
+        {
+            if(weatherData.poll() == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        const ConsumerStatus status = weatherData.status();
+        std::cout << std::setw(10) << label << ": received " << display.received() << ", skipped " << status.skipped
+                  << ", flagged lagging " << status.flagged << " times, torn " << display.torn() << std::endl;
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << label << ": " << error.what() << std::endl;
+        code = 1;
+    }
+    std::cout.flush();
+    ::_exit(code);
+}
+
+// Waits for the children that have exited, so that the ring sees them gone.
+static void reapChildren(std::vector<pid_t>& children)
+{
+    for(auto& child : children)
+    {
+        if(child > 0 && ::waitpid(child, nullptr, WNOHANG) == child)
+        {
+            child = 0;
+        }
+    }
+}
+
+// Waits until every child has attached to the ring; false as soon as one has exited instead.
+static bool waitForAttach(const SharedWeatherRing& ring, std::vector<pid_t>& children)
+{
+    while(ring.attachedConsumers() < children.size())
+    {
+        for(auto& child : children)
+        {
+            if(child > 0 && ::waitpid(child, nullptr, WNOHANG) == child)
+            {
+                child = 0;
+                return false;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Closes the ring, so that the children that did attach finish, and waits for all of them.
+static void stopChildren(SharedWeatherRing& ring, std::vector<pid_t>& children)
+{
+    ring.close();
+    for(auto child : children)
+    {
+        if(child > 0)
+        {
+            ::waitpid(child, nullptr, 0);
+        }
+    }
+    children.clear();
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer across processes over shared memory" << std::endl;
+    const std::string name = "/weather-ring-" + std::to_string(::getpid());
+
+    {
+        SharedWeatherRing ring(name, 1024, 4);
+        std::cout.flush();
+        const pid_t display = ::fork();
+        if(display < 0)
+        {
+            std::cerr << "could not start the display process: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        if(display == 0)
+        {
+            int code = 0;
+            try
+            {
+                SharedWeatherRing remote(name);
+                RemoteWeatherData weatherData(remote);
+                CurrentConditionsDisplay currentDisplay(&weatherData);
+                while(!weatherData.finished())
+                {
+                    weatherData.poll();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            catch(const std::exception& error)
+            {
+                std::cerr << "display: " << error.what() << std::endl;
+                code = 1;
+            }
+            std::cout.flush();
+            ::_exit(code);
+        }
+
+        std::vector<pid_t> displays{display};
+        if(!waitForAttach(ring, displays))
+        {
+            std::cerr << "the display process exited before it attached" << std::endl;
+            stopChildren(ring, displays);
+            return 1;
+        }
+        WeatherData weatherData;
+        SharedMemoryPublisher publisher(&weatherData, ring);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        stopChildren(ring, displays);
+        std::cout << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 4M measurements at about 1M per second
+    * into a ring of 64k, read by four display processes:
+    * two that keep up, one that naps every 64 updates,
+    * and one that crashes after 100000.
+    ********************************************* */
+
+    const std::uint64_t measurements = 4000000;
+    const std::uint64_t perMillisecond = 1000;
+
+    SharedWeatherRing ring(name, 1u << 16, 8);
+    std::cout.flush();
+
+    struct Spec {
+        const char* label;
+        std::uint64_t delay;
+        std::uint64_t crashAfter;
+    };
+    const Spec specs[] = {{"fast 1", 0, 0}, {"fast 2", 0, 0}, {"slow", 500, 0}, {"crashing", 0, 100000}};
+    std::vector<pid_t> children;
+    for(const auto& spec : specs)
+    {
+        const pid_t child = ::fork();
+        if(child < 0)
+        {
+            std::cerr << "could not start display process " << spec.label << ": " << std::strerror(errno) << std::endl;
+            stopChildren(ring, children);
+            return 1;
+        }
+        if(child == 0)
+        {
+            runDisplayProcess(name, spec.label, spec.delay, spec.crashAfter);
+        }
+        children.push_back(child);
+    }
+    if(!waitForAttach(ring, children))
+    {
+        std::cerr << "a display process exited before it attached" << std::endl;
+        stopChildren(ring, children);
+        return 1;
+    }
+
+    WeatherData weatherData;
+    SharedMemoryPublisher publisher(&weatherData, ring);
+
+    std::chrono::steady_clock::duration publishing{0};
+    auto next = std::chrono::steady_clock::now();
+    for(std::uint64_t i = 0; i < measurements; i += perMillisecond)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(std::uint64_t j = i; j < i + perMillisecond; ++j)
+        {
+            const float temperature = static_cast<float>(j % 4096);
+            weatherData.setMeasurements(temperature, temperature + 1.0f, temperature + 2.0f);
+        }
+        publishing += std::chrono::steady_clock::now() - start;
+        reapChildren(children);
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+    }
+    stopChildren(ring, children);
+    ring.checkConsumers();
+
+    std::cout << "producer: " << ring.published() << " measurements, "
+              << std::chrono::duration<double, std::nano>(publishing).count() / static_cast<double>(measurements)
+              << " ns per setMeasurements, " << ring.reclaimed() << " slot(s) of crashed displays reclaimed" << std::endl;
+}
@@ -0,0 +1,474 @@
+/* *********************************************
+* This example implements the OBSERVER design
+* pattern with the statistics display from the
+* book, built as a streaming engine.
+*
+* RollingStatistics keeps a running mean and variance
+* over everything it has seen (Welford), and the mean,
+* variance, minimum and maximum of a sliding window
+* bounded by a sample count, an age, or both. The
+* minimum and maximum come from monotonic deques.
+* All buffers are rings sized once in the constructor,
+* so add() is O(1) amortized and never allocates.
+*
+* The engine is checked against a naive recomputation
+* of the window and then benchmarked.
+********************************************* */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <deque>
+#include <list>
+#include <algorithm>
+#include <numeric>
+
+class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void update(float temp, float humidity, float pressure) = 0;
+};
+
+class Subject {
+    public:
+        virtual ~Subject() = default;
+        virtual void registerObserver(Observer* o) = 0;
+        virtual void removeObserver(Observer* o) = 0;
+        virtual void notifyObservers() = 0;
+};
+
+class DisplayElement{
+    public:
+        virtual ~DisplayElement() = default;
+        virtual void display() = 0;
+
+};
+
+class WeatherData : public Subject {
+    private:
+        std::list<Observer*> m_observers;
+        float m_temperature;
+        float m_humidity;
+        float m_pressure;
+
+    public:
+        WeatherData() : m_observers(), m_temperature(0), m_humidity(0), m_pressure(0)
+        {
+
+        }
+
+        void registerObserver(Observer* o) override {
+            m_observers.push_back(o);
+        }
+
+        void removeObserver(Observer* o) override {
+            m_observers.remove(o);
+        }
+
+        void notifyObservers() override {
+            for(auto observer : m_observers)
+            {
+                observer->update(m_temperature, m_humidity, m_pressure);
+            }
+        }
+
+        void measurementsChanged(){
+            notifyObservers();
+        }
+
+        void setMeasurements(float temperature, float humidity, float pressure){
+            m_temperature = temperature;
+            m_humidity = humidity;
+            m_pressure = pressure;
+            measurementsChanged();
+        }
+
+};
+
+/* *********************************************
+* Streaming statistics of one value. Samples carry
+* a timestamp in nanoseconds that must not decrease.
+* A maxAge of zero means the window is bounded by
+* maxSamples alone.
+*
+* The sample ring and both deques are indexed by a
+* running sequence number masked to a power of two.
+* A deque never holds more entries than the window,
+* so none of them can overflow.
+*
+* Removing a sample runs Welford backwards, which
+* lets rounding errors pile up on a long stream, so the
+* window mean and M2 are recomputed from the ring every
+* 2^20 evictions (or once per window, if that is
+* longer).
+********************************************* */
+
+class RollingStatistics {
+
+    public:
+        static constexpr std::uint64_t resumInterval = 1u << 20;
+
+        explicit RollingStatistics(std::size_t maxSamples, std::int64_t maxAge = 0)
+            : m_maxSamples(std::max<std::size_t>(1, maxSamples)), m_maxAge(maxAge), m_mask(0),
+              m_values(), m_times(), m_minimums(), m_maximums(),
+              m_head(0), m_next(0), m_minHead(0), m_minTail(0), m_maxHead(0), m_maxTail(0),
+              m_windowMean(0.0), m_windowM2(0.0), m_sinceResum(0), m_totalCount(0), m_totalMean(0.0), m_totalM2(0.0)
+        {
+            std::size_t capacity = 1;
+            while(capacity < m_maxSamples)
+            {
+                capacity *= 2;
+            }
+            m_mask = capacity - 1;
+            m_values.resize(capacity);
+            m_times.resize(capacity);
+            m_minimums.resize(capacity);
+            m_maximums.resize(capacity);
+        }
+
+        void add(double value, std::int64_t time) {
+            if(count() == m_maxSamples)
+            {
+                evictOldest();
+            }
+            if(m_maxAge > 0)
+            {
+                while(count() > 0 && time - m_times[m_head & m_mask] >= m_maxAge)
+                {
+                    evictOldest();
+                }
+            }
+
+            const std::uint64_t sequence = m_next++;
+            m_values[sequence & m_mask] = value;
+            m_times[sequence & m_mask] = time;
+
+            // Welford, once for the window and once for everything seen so far
+            const double windowDelta = value - m_windowMean;
+            m_windowMean += windowDelta / static_cast<double>(count());
+            m_windowM2 += windowDelta * (value - m_windowMean);
+
+            ++m_totalCount;
+            const double totalDelta = value - m_totalMean;
+            m_totalMean += totalDelta / static_cast<double>(m_totalCount);
+            m_totalM2 += totalDelta * (value - m_totalMean);
+
+            // entries that can never be the minimum (maximum) again leave from the back
+            while(m_minTail != m_minHead && m_values[m_minimums[(m_minTail - 1) & m_mask] & m_mask] >= value)
+            {
+                --m_minTail;
+            }
+            m_minimums[m_minTail++ & m_mask] = sequence;
+
+            while(m_maxTail != m_maxHead && m_values[m_maximums[(m_maxTail - 1) & m_mask] & m_mask] <= value)
+            {
+                --m_maxTail;
+            }
+            m_maximums[m_maxTail++ & m_mask] = sequence;
+        }
+
+        std::size_t count() const {
+            return static_cast<std::size_t>(m_next - m_head);
+        }
+
+        double mean() const {
+            return m_windowMean;
+        }
+
+        // Sample variance of the window.
+        double variance() const {
+            return count() > 1 ? std::max(0.0, m_windowM2) / static_cast<double>(count() - 1) : 0.0;
+        }
+
+        double min() const {
+            return count() > 0 ? m_values[m_minimums[m_minHead & m_mask] & m_mask] : 0.0;
+        }
+
+        double max() const {
+            return count() > 0 ? m_values[m_maximums[m_maxHead & m_mask] & m_mask] : 0.0;
+        }
+
+        std::uint64_t totalCount() const {
+            return m_totalCount;
+        }
+
+        double totalMean() const {
+            return m_totalMean;
+        }
+
+        double totalVariance() const {
+            return m_totalCount > 1 ? m_totalM2 / static_cast<double>(m_totalCount - 1) : 0.0;
+        }
+
+    private:
+        void evictOldest() {
+            const std::uint64_t sequence = m_head++;
+            const double value = m_values[sequence & m_mask];
+
+            // Welford run backwards
+            if(count() == 0)
+            {
+                m_windowMean = 0.0;
+                m_windowM2 = 0.0;
+            }
+            else
+            {
+                const double delta = value - m_windowMean;
+                m_windowMean -= delta / static_cast<double>(count());
+                m_windowM2 = std::max(0.0, m_windowM2 - delta * (value - m_windowMean));
+            }
+            if(++m_sinceResum >= std::max<std::uint64_t>(resumInterval, m_mask + 1))
+            {
+                resum();
+            }
+
+            if(m_minimums[m_minHead & m_mask] == sequence)
+            {
+                ++m_minHead;
+            }
+            if(m_maximums[m_maxHead & m_mask] == sequence)
+            {
+                ++m_maxHead;
+            }
+        }
+
+        // Two passes over the window for the mean and M2.
+        void resum() {
+            m_sinceResum = 0;
+            const std::size_t samples = count();
+            if(samples == 0)
+            {
+                m_windowMean = 0.0;
+                m_windowM2 = 0.0;
+                return;
+            }
+            double sum = 0.0;
+            for(std::uint64_t sequence = m_head; sequence != m_next; ++sequence)
+            {
+                sum += m_values[sequence & m_mask];
+            }
+            const double mean = sum / static_cast<double>(samples);
+            double m2 = 0.0;
+            for(std::uint64_t sequence = m_head; sequence != m_next; ++sequence)
+            {
+                const double delta = m_values[sequence & m_mask] - mean;
+                m2 += delta * delta;
+            }
+            m_windowMean = mean;
+            m_windowM2 = m2;
+        }
+
+        std::size_t m_maxSamples;
+        std::int64_t m_maxAge;
+        std::uint64_t m_mask;
+
+        std::vector<double> m_values;
+        std::vector<std::int64_t> m_times;
+        std::vector<std::uint64_t> m_minimums;
+        std::vector<std::uint64_t> m_maximums;
+
+        std::uint64_t m_head;
+        std::uint64_t m_next;
+        std::uint64_t m_minHead;
+        std::uint64_t m_minTail;
+        std::uint64_t m_maxHead;
+        std::uint64_t m_maxTail;
+
+        double m_windowMean;
+        double m_windowM2;
+        std::uint64_t m_sinceResum;
+
+        std::uint64_t m_totalCount;
+        double m_totalMean;
+        double m_totalM2;
+};
+
+class StatisticsDisplay : public Observer, public DisplayElement {
+    private:
+        RollingStatistics m_temperature;
+        std::chrono::steady_clock::time_point m_start;
+        Subject* m_weatherData;
+
+    public:
+        StatisticsDisplay(Subject* weatherData, std::size_t maxSamples, std::chrono::nanoseconds maxAge = std::chrono::nanoseconds(0))
+            : m_temperature(maxSamples, maxAge.count()), m_start(std::chrono::steady_clock::now()), m_weatherData(weatherData)
+        {
+            m_weatherData->registerObserver(this);
+        }
+
+        StatisticsDisplay(const StatisticsDisplay&) = default;
+        StatisticsDisplay& operator=(const StatisticsDisplay&) = default;
+
+        void update(float temperature, float humidity, float pressure) override {
+            (void)humidity;
+            (void)pressure;
+            const auto now = std::chrono::steady_clock::now() - m_start;
+            m_temperature.add(temperature, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+            display();
+        }
+
+        void display() override {
+            std::cout << "Avg/Max/Min temperature = " << m_temperature.mean() << "/" << m_temperature.max()
+                      << "/" << m_temperature.min() << " over the last " << m_temperature.count() << " readings" << std::endl;
+        }
+
+};
+
+/* *********************************************
+* Reference implementation for the validation: the
+* window is kept in a std::deque and every statistic
+* is recomputed from scratch.
+********************************************* */
+
+struct NaiveWindow {
+    std::size_t maxSamples;
+    std::int64_t maxAge;
+    std::deque<std::pair<double, std::int64_t>> samples;
+
+    void add(double value, std::int64_t time) {
+        if(samples.size() == maxSamples)
+        {
+            samples.pop_front();
+        }
+        while(maxAge > 0 && !samples.empty() && time - samples.front().second >= maxAge)
+        {
+            samples.pop_front();
+        }
+        samples.emplace_back(value, time);
+    }
+
+    bool matches(const RollingStatistics& statistics) const {
+        double sum = 0.0;
+        double minimum = samples.front().first;
+        double maximum = samples.front().first;
+        for(const auto& sample : samples)
+        {
+            sum += sample.first;
+            minimum = std::min(minimum, sample.first);
+            maximum = std::max(maximum, sample.first);
+        }
+        const double mean = sum / static_cast<double>(samples.size());
+        double squares = 0.0;
+        for(const auto& sample : samples)
+        {
+            squares += (sample.first - mean) * (sample.first - mean);
+        }
+        const double variance = samples.size() > 1 ? squares / static_cast<double>(samples.size() - 1) : 0.0;
+
+        return statistics.count() == samples.size()
+            && statistics.min() == minimum
+            && statistics.max() == maximum
+            && std::abs(statistics.mean() - mean) <= 1e-9 * (1.0 + std::abs(mean))
+            && std::abs(statistics.variance() - variance) <= 1e-6 * (1.0 + variance);
+    }
+};
+
+// Compares against the naive window after every sample, returns the number of mismatches.
+static std::size_t validate(std::size_t maxSamples, std::int64_t maxAge, std::size_t samples)
+{
+    std::mt19937 random(42);
+    std::normal_distribution<double> temperature(20.0, 5.0);
+    std::uniform_int_distribution<std::int64_t> gap(0, 2000);
+
+    RollingStatistics statistics(maxSamples, maxAge);
+    NaiveWindow naive{maxSamples, maxAge, {}};
+    std::int64_t time = 0;
+    std::size_t mismatches = 0;
+
+    for(std::size_t i = 0; i < samples; ++i)
+    {
+        // rounded so that equal values, which the deques must keep apart, show up too
+        const double value = std::round(temperature(random) * 10.0) / 10.0;
+        time += gap(random);
+        statistics.add(value, time);
+        naive.add(value, time);
+        if(!naive.matches(statistics))
+        {
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+int main(void)
+{
+    std::cout << "chapter 2 - observer with a streaming statistics display" << std::endl;
+
+    {
+        WeatherData weatherData;
+        StatisticsDisplay statisticsDisplay(&weatherData, 2);
+
+        weatherData.setMeasurements(12.0, 65.0, 29.2);
+        weatherData.setMeasurements(20.0, 55.0, 29.2);
+        weatherData.setMeasurements(24.0, 45.0, 29.2);
+        std::cout << std::endl;
+    }
+
+    std::cout << "validation against naive recomputation:" << std::endl;
+    std::cout << "  count window of 100:      " << validate(100, 0, 100000) << " mismatches" << std::endl;
+    std::cout << "  time window of 50 us:     " << validate(4096, 50000, 100000) << " mismatches" << std::endl;
+    std::cout << "  both, 64 samples / 50 us: " << validate(64, 50000, 100000) << " mismatches" << std::endl;
+
+    // a long stream with a large offset and little spread, where backwards Welford drifts the most
+    {
+        RollingStatistics longStream(16);
+        std::mt19937 random(3);
+        std::normal_distribution<double> noise(0.0, 0.01);
+        std::deque<double> last;
+        for(std::size_t i = 0; i < 10000000; ++i)
+        {
+            const double value = 1e6 + noise(random);
+            longStream.add(value, static_cast<std::int64_t>(i));
+            last.push_back(value);
+            if(last.size() > 16)
+            {
+                last.pop_front();
+            }
+        }
+        const double mean = std::accumulate(last.begin(), last.end(), 0.0) / static_cast<double>(last.size());
+        double m2 = 0.0;
+        for(double value : last)
+        {
+            m2 += (value - mean) * (value - mean);
+        }
+        const double variance = m2 / static_cast<double>(last.size() - 1);
+        std::cout << "  10M samples around 1e6:   variance off by "
+                  << std::abs(longStream.variance() - variance) / variance * 100.0 << "%" << std::endl;
+    }
+
+    /* *********************************************
+    * Benchmark: 20 million samples through a window of
+    * 1024 samples and 100 us, one sample every 100 ns.
+    * The result is printed so the work is not optimized
+    * away.
+    ********************************************* */
+
+    const std::size_t samples = 20000000;
+    std::vector<double> values(4096);
+    std::mt19937 random(7);
+    std::normal_distribution<double> temperature(20.0, 5.0);
+    for(auto& value : values)
+    {
+        value = temperature(random);
+    }
+
+    RollingStatistics statistics(1024, 100000);
+    double checksum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < samples; ++i)
+    {
+        statistics.add(values[i & (values.size() - 1)], static_cast<std::int64_t>(i) * 100);
+        checksum += statistics.max() - statistics.min();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+
+    std::cout << std::endl << std::fixed << std::setprecision(1)
+              << "benchmark: " << samples / seconds / 1e6 << "M updates/s ("
+              << seconds * 1e9 / samples << " ns per update), window mean " << statistics.mean()
+              << ", overall mean " << statistics.totalMean() << ", checksum " << checksum << std::endl;
+}